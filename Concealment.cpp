@@ -0,0 +1,251 @@
+#include "Concealment.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+template<typename Sample>
+Concealer<Sample>::Concealer(const ConcealmentStrategy strategy, const std::size_t channels, const std::uint32_t clock_rate, const std::chrono::milliseconds fade)
+    : strategy(strategy),
+      channels(channels),
+      min_period(clock_rate / MAX_PITCH_HZ),
+      max_period(clock_rate / MIN_PITCH_HZ),
+      fade_step(1),
+      history_capacity(2 * max_period * channels),
+      ring_capacity(history_capacity),
+      history_end(0),
+      history_size(0),
+      last_packet_samples(0),
+      concealing(false),
+      segment_samples(0),
+      segment_offset(0),
+      gain(0),
+      noise_floor(-1),
+      noise_state() {
+  if (channels == 0) {
+    throw std::invalid_argument("Channels must be at least 1.");
+  }
+  if (min_period == 0) {
+    throw std::invalid_argument("Clock rate too low to conceal.");
+  }
+  if (fade.count() < 0) {
+    throw std::invalid_argument("Fade must not be negative.");
+  }
+  const auto fade_samples = static_cast<std::size_t>(fade.count()) * clock_rate / 1000 * channels;
+  if (fade_samples > 0) {
+    fade_step = 1.0F / static_cast<float>(fade_samples);
+  }
+  for (std::size_t lane = 0; lane < NOISE_LANES; lane++) {
+    // Any non-zero seed works; distinct ones keep the lanes uncorrelated.
+    noise_state[lane] = 0x9E3779B9U * static_cast<std::uint32_t>(lane + 1);
+  }
+  history.resize(2 * ring_capacity);
+}
+
+template<typename Sample>
+void Concealer<Sample>::Observe(const Packet &packet) {
+  Check(packet);
+  const auto *samples = static_cast<const Sample *>(packet.data);
+  const std::size_t count = packet.elements * channels;
+
+  Remember(samples, count);
+  last_packet_samples = count;
+
+  // Track the background level: drop straight to quieter packets, creep up towards louder ones.
+  const float rms = Rms(samples, count);
+  if (noise_floor < 0 || rms < noise_floor) {
+    noise_floor = rms;
+  } else {
+    noise_floor += (rms - noise_floor) * NOISE_FLOOR_RISE;
+  }
+  concealing = false;
+}
+
+template<typename Sample>
+void Concealer<Sample>::operator()(const std::span<Packet> packets) {
+  for (Packet &packet: packets) {
+    Check(packet);
+    if (!concealing) {
+      Begin();
+    }
+    auto *destination = static_cast<Sample *>(packet.data);
+    const std::size_t samples = packet.elements * channels;
+    switch (strategy) {
+      case ConcealmentStrategy::Silence:
+        memset(destination, 0, samples * sizeof(Sample));
+        break;
+      case ConcealmentStrategy::Repeat:
+      case ConcealmentStrategy::PitchRepetition:
+        Repeat(destination, samples);
+        break;
+      case ConcealmentStrategy::ComfortNoise:
+        Noise(destination, samples);
+        break;
+    }
+  }
+}
+
+template<typename Sample>
+void Concealer<Sample>::Check(const Packet &packet) const {
+  if (packet.length != packet.elements * channels * sizeof(Sample)) {
+    std::ostringstream message;
+    message << "Packet length doesn't match its elements. Was: " << packet.length << ", expected: " << packet.elements * channels * sizeof(Sample);
+    throw std::invalid_argument(message.str());
+  }
+}
+
+template<typename Sample>
+void Concealer<Sample>::Remember(const Sample *samples, const std::size_t count) {
+  // Keep at least the whole of the last packet, for Repeat. Only a packet bigger than any before resizes the ring,
+  // and it replaces everything in it.
+  if (count > ring_capacity) {
+    ring_capacity = count;
+    history.resize(2 * ring_capacity);
+    history_end = 0;
+    history_size = 0;
+  }
+  std::size_t written = 0;
+  while (written < count) {
+    const std::size_t chunk = std::min(ring_capacity - history_end, count - written);
+    memcpy(history.data() + history_end, samples + written, chunk * sizeof(Sample));
+    memcpy(history.data() + history_end + ring_capacity, samples + written, chunk * sizeof(Sample));
+    history_end = (history_end + chunk) % ring_capacity;
+    written += chunk;
+  }
+  history_size = std::min(history_size + count, ring_capacity);
+}
+
+template<typename Sample>
+const Sample *Concealer<Sample>::Newest(const std::size_t samples) const {
+  return history.data() + history_end + ring_capacity - samples;
+}
+
+template<typename Sample>
+void Concealer<Sample>::Begin() {
+  concealing = true;
+  gain = 1;
+  segment_offset = 0;
+  segment_samples = std::min(last_packet_samples, history_size);
+  if (strategy == ConcealmentStrategy::PitchRepetition) {
+    const std::size_t period = FindPeriod();
+    if (period > 0) {
+      segment_samples = period * channels;
+    }
+  }
+}
+
+template<typename Sample>
+void Concealer<Sample>::Repeat(Sample *destination, const std::size_t samples) {
+  if (segment_samples == 0) {
+    memset(destination, 0, samples * sizeof(Sample));
+    return;
+  }
+
+  // Loop the segment, ramping the gain down linearly across the whole gap.
+  const Sample *segment = Newest(segment_samples);
+  std::size_t written = 0;
+  while (written < samples) {
+    const std::size_t chunk = std::min(segment_samples - segment_offset, samples - written);
+    const Sample *source = segment + segment_offset;
+    Sample *output = destination + written;
+    const float start = gain;
+    const float step = fade_step;
+    for (std::int32_t index = 0; index < static_cast<std::int32_t>(chunk); index++) {
+      const float scale = std::max(start - (step * static_cast<float>(index)), 0.0F);
+      output[index] = static_cast<Sample>(static_cast<float>(source[index]) * scale);
+    }
+    gain = std::max(gain - (fade_step * static_cast<float>(chunk)), 0.0F);
+    written += chunk;
+    segment_offset = (segment_offset + chunk) % segment_samples;
+  }
+}
+
+template<typename Sample>
+void Concealer<Sample>::Noise(Sample *destination, const std::size_t samples) {
+  // Uniform noise over +/- amplitude has an RMS of amplitude / sqrt(3).
+  const float full_scale = std::is_floating_point_v<Sample> ? 1.0F : static_cast<float>(std::numeric_limits<Sample>::max());
+  const float amplitude = std::min(std::max(noise_floor, 0.0F) * std::sqrt(3.0F), full_scale);
+  const float scale = amplitude / 2147483648.0F;
+
+  // Xorshift in each lane, a block of lanes at a time.
+  std::array<std::uint32_t, NOISE_LANES> state = noise_state;
+  std::array<Sample, NOISE_LANES> block;
+  for (std::size_t offset = 0; offset < samples; offset += NOISE_LANES) {
+    for (std::size_t lane = 0; lane < NOISE_LANES; lane++) {
+      std::uint32_t value = state[lane];
+      value ^= value << 13;
+      value ^= value >> 17;
+      value ^= value << 5;
+      state[lane] = value;
+      block[lane] = static_cast<Sample>(static_cast<float>(static_cast<std::int32_t>(value)) * scale);
+    }
+    memcpy(destination + offset, block.data(), std::min(NOISE_LANES, samples - offset) * sizeof(Sample));
+  }
+  noise_state = state;
+}
+
+template<typename Sample>
+std::size_t Concealer<Sample>::FindPeriod() const {
+  // Compare the most recent max_period elements against those a candidate period earlier.
+  const std::size_t window = max_period * channels;
+  if (history_size < 2 * window) {
+    return 0;
+  }
+  const Sample *recent = Newest(window);
+  const auto correlation = [&](const std::size_t period) {
+    const Sample *earlier = recent - (period * channels);
+    double cross = 0;
+    double energy_recent = 0;
+    double energy_earlier = 0;
+    for (std::size_t index = 0; index < window; index++) {
+      const auto a = static_cast<double>(recent[index]);
+      const auto b = static_cast<double>(earlier[index]);
+      cross += a * b;
+      energy_recent += a * a;
+      energy_earlier += b * b;
+    }
+    return energy_recent > 0 && energy_earlier > 0 ? cross / std::sqrt(energy_recent * energy_earlier) : 0;
+  };
+
+  // Coarse search, then refine around the best candidate.
+  double best_correlation = -std::numeric_limits<double>::infinity();
+  std::size_t best = min_period;
+  for (std::size_t period = min_period; period <= max_period; period += SEARCH_STEP) {
+    const double candidate = correlation(period);
+    if (candidate > best_correlation) {
+      best_correlation = candidate;
+      best = period;
+    }
+  }
+  const std::size_t coarse = best;
+  const std::size_t from = coarse > min_period + SEARCH_STEP ? coarse - SEARCH_STEP + 1 : min_period;
+  const std::size_t to = std::min(coarse + SEARCH_STEP - 1, max_period);
+  for (std::size_t period = from; period <= to; period++) {
+    const double candidate = correlation(period);
+    if (candidate > best_correlation) {
+      best_correlation = candidate;
+      best = period;
+    }
+  }
+  return best_correlation >= MIN_CORRELATION ? best : 0;
+}
+
+template<typename Sample>
+float Concealer<Sample>::Rms(const Sample *samples, const std::size_t count) const {
+  if (count == 0) {
+    return 0;
+  }
+  double energy = 0;
+  for (std::size_t index = 0; index < count; index++) {
+    const auto sample = static_cast<double>(samples[index]);
+    energy += sample * sample;
+  }
+  return static_cast<float>(std::sqrt(energy / static_cast<double>(count)));
+}
+
+template class Concealer<std::int16_t>;
+template class Concealer<float>;
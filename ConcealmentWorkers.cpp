@@ -0,0 +1,110 @@
+#include "ConcealmentWorkers.hh"
+
+#include <cstring>
+#include <stdexcept>
+
+ConcealmentWorkers::ConcealmentWorkers(const std::size_t workers, const cantina::LoggerPointer &logger)
+    : logger(std::make_shared<cantina::Logger>("CONCEAL", logger)),
+      next_worker(0) {
+  const std::size_t count = workers > 0 ? workers : std::max(std::thread::hardware_concurrency(), 1u);
+  for (std::size_t index = 0; index < count; index++) {
+    this->workers.push_back(std::make_unique<Worker>());
+  }
+  for (const auto &worker: this->workers) {
+    worker->thread = std::thread([this, &worker = *worker]() { Work(worker); });
+  }
+  this->logger->debug << "Started ConcealmentWorkers with: " << count << " workers" << std::flush;
+}
+
+ConcealmentWorkers::~ConcealmentWorkers() {
+  for (const auto &worker: workers) {
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      worker->stop = true;
+    }
+    worker->wake.notify_one();
+  }
+  for (const auto &worker: workers) {
+    worker->thread.join();
+  }
+}
+
+std::size_t ConcealmentWorkers::Assign() {
+  return next_worker++ % workers.size();
+}
+
+void ConcealmentWorkers::Submit(const std::size_t worker, const std::span<const Job> jobs) {
+  if (worker >= workers.size()) {
+    throw std::invalid_argument("Unknown concealment worker");
+  }
+  Worker &target = *workers[worker];
+  {
+    std::lock_guard<std::mutex> lock(target.mutex);
+    target.queue.insert(target.queue.end(), jobs.begin(), jobs.end());
+    target.submitted += jobs.size();
+  }
+  target.wake.notify_one();
+}
+
+void ConcealmentWorkers::Drain(const std::size_t worker) {
+  Worker &target = *workers.at(worker);
+  std::unique_lock<std::mutex> lock(target.mutex);
+  const std::size_t submitted = target.submitted;
+  target.idle.wait(lock, [&target, submitted]() { return target.finished >= submitted; });
+}
+
+void ConcealmentWorkers::Drain() {
+  for (std::size_t worker = 0; worker < workers.size(); worker++) {
+    Drain(worker);
+  }
+}
+
+void ConcealmentWorkers::Work(Worker &worker) {
+  std::unique_lock<std::mutex> lock(worker.mutex);
+  while (true) {
+    // Stopping still finishes the queue, as owners may be waiting on it.
+    worker.wake.wait(lock, [&worker]() { return worker.stop || !worker.queue.empty(); });
+    if (worker.queue.empty()) {
+      return;
+    }
+    Job job = worker.queue.front();
+    worker.queue.pop_front();
+    lock.unlock();
+
+    worker.scratch.resize(job.packet.length);
+    Packet packet = job.packet;
+    packet.data = worker.scratch.data();
+    try {
+      (*job.callback)(std::span<Packet>(&packet, 1));
+    } catch (const std::exception &ex) {
+      // The slot is still freed, and plays whatever it holds.
+      logger->warning << "[" << job.packet.sequence_number << "] Concealment failed: " << ex.what() << std::flush;
+    }
+    Fill(job, worker.scratch);
+
+    lock.lock();
+    worker.finished++;
+    worker.idle.notify_all();
+  }
+}
+
+void ConcealmentWorkers::Fill(const Job &job, const std::vector<std::uint8_t> &scratch) {
+  std::uint16_t state = job.state->load(std::memory_order::acquire);
+  std::uint16_t release = job.done_flags;
+  while (state & job.wanted_flag) {
+    if (state & job.claim_flag) {
+      // Someone is briefly looking at the slot: a real packet being copied in, or a reader passing it by.
+      std::this_thread::yield();
+      state = job.state->load(std::memory_order::acquire);
+      continue;
+    }
+    if (job.state->compare_exchange_weak(state, state | job.claim_flag, std::memory_order::acquire, std::memory_order::acquire)) {
+      memcpy(job.packet.data, scratch.data(), job.packet.length);
+      release |= job.claim_flag;
+      break;
+    }
+  }
+  // Otherwise real data got there first, and takes precedence. Either way, released, so whoever sees the flags cleared
+  // sees the elements written.
+  job.state->fetch_and(static_cast<std::uint16_t>(~release), std::memory_order::release);
+}
@@ -0,0 +1,81 @@
+#include "DriftEstimator.hh"
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace std::chrono;
+
+DriftEstimator::DriftEstimator(const seconds time_constant)
+    : time_constant(static_cast<double>(time_constant.count())) {
+  if (time_constant.count() <= 0) {
+    throw std::invalid_argument("Time constant must be positive.");
+  }
+}
+
+void DriftEstimator::Arrived(const std::uint64_t total, const nanoseconds at) {
+  arrived.Add(total, at, time_constant);
+}
+
+void DriftEstimator::Consumed(const std::uint64_t total, const nanoseconds now) {
+  consumed.Add(total, now, time_constant);
+}
+
+void DriftEstimator::Interrupted() {
+  arrived.interrupted = arrived.first_time.has_value();
+  consumed.interrupted = consumed.first_time.has_value();
+}
+
+std::optional<double> DriftEstimator::GetDrift() const {
+  const std::optional<double> arrival_rate = arrived.GetSlope(time_constant);
+  const std::optional<double> consumption_rate = consumed.GetSlope(time_constant);
+  if (!arrival_rate.has_value() || !consumption_rate.has_value() || consumption_rate.value() <= 0) {
+    return std::nullopt;
+  }
+  return (arrival_rate.value() / consumption_rate.value()) - 1;
+}
+
+void DriftEstimator::Fit::Add(const std::uint64_t new_total, const nanoseconds now, const double time_constant) {
+  if (!first_time.has_value()) {
+    first_time = now;
+  } else if (now <= last_time) {
+    return;
+  } else if (interrupted) {
+    // Splice this sample onto the last, dropping the gap between them.
+    interrupted = false;
+    last_time = now;
+    last_total = new_total;
+    return;
+  } else {
+    // Move the origin to this sample: shift every sum by how far time and the total moved.
+    const double shift = duration<double>(now - last_time).count();
+    const auto total_shift = static_cast<double>(new_total - last_total);
+    total_time += (shift * total_shift * weight) - (shift * total) - (total_shift * time);
+    time_squared += (shift * shift * weight) - (2 * shift * time);
+    time -= shift * weight;
+    total -= total_shift * weight;
+
+    // Then fade everything by how long has passed.
+    const double decay = std::exp(-shift / time_constant);
+    weight *= decay;
+    time *= decay;
+    time_squared *= decay;
+    total *= decay;
+    total_time *= decay;
+  }
+
+  // The new sample sits at the origin, so only adds weight.
+  weight += 1;
+  last_time = now;
+  last_total = new_total;
+}
+
+std::optional<double> DriftEstimator::Fit::GetSlope(const double time_constant) const {
+  if (!first_time.has_value() || duration<double>(last_time - first_time.value()).count() < time_constant) {
+    return std::nullopt;
+  }
+  const double variance = (weight * time_squared) - (time * time);
+  if (variance <= 0) {
+    return std::nullopt;
+  }
+  return ((weight * total_time) - (time * total)) / variance;
+}
@@ -0,0 +1,267 @@
+#include "JitterBufferPool.hh"
+
+#include <sstream>
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+JitterBufferPool::JitterBufferPool(const std::size_t shards, const ConcealmentCallback &concealment_callback, const cantina::LoggerPointer &logger, const bool pin, const bool huge_pages)
+    : logger(std::make_shared<cantina::Logger>("JPOOL", logger)),
+      concealment_callback(concealment_callback),
+      arena(std::make_shared<RingArena>(RingArena::DEFAULT_REGION_SIZE, huge_pages)),
+      next_stream(0),
+      ticks_outstanding(0) {
+  if (!concealment_callback) {
+    throw std::invalid_argument("Concealment callback must be set.");
+  }
+  const std::size_t count = shards > 0 ? shards : std::max(std::thread::hardware_concurrency(), 1u);
+  for (std::size_t index = 0; index < count; index++) {
+    auto shard = std::make_unique<Shard>();
+    shard->slots = std::make_unique<Slot[]>(INGRESS_SLOTS);
+    for (std::size_t position = 0; position < INGRESS_SLOTS; position++) {
+      shard->slots[position].sequence.store(position, std::memory_order_relaxed);
+    }
+    this->shards.push_back(std::move(shard));
+  }
+
+  // Every shard must exist before any worker starts.
+  for (std::size_t index = 0; index < count; index++) {
+    Shard &shard = *this->shards[index];
+    shard.worker = std::thread([this, &shard]() { Work(shard); });
+    if (pin) {
+      Pin(shard.worker, index);
+    }
+  }
+  this->logger->debug << "Started JitterBufferPool with: " << count << " shards" << std::flush;
+}
+
+JitterBufferPool::~JitterBufferPool() {
+  for (const auto &shard: shards) {
+    {
+      std::lock_guard<std::mutex> lock(shard->wake_mutex);
+      shard->stop = true;
+    }
+    shard->wake.notify_one();
+  }
+  for (const auto &shard: shards) {
+    shard->worker.join();
+  }
+}
+
+JitterBufferPool::StreamId JitterBufferPool::AddStream(const std::size_t element_size,
+                                                       const std::size_t packet_elements,
+                                                       const std::uint32_t clock_rate,
+                                                       const std::chrono::milliseconds max_length,
+                                                       const std::chrono::milliseconds min_length) {
+  Stream stream{
+          .buffer = std::make_unique<JitterBuffer>(element_size, packet_elements, clock_rate, max_length, min_length, logger, nullptr, arena),
+          .output = std::vector<std::uint8_t>(),
+  };
+  const StreamId id = next_stream++;
+  Shard &shard = ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.streams_mutex);
+  shard.streams.emplace(id, std::move(stream));
+  return id;
+}
+
+void JitterBufferPool::RemoveStream(const StreamId stream) {
+  Shard &shard = ShardFor(stream);
+  std::lock_guard<std::mutex> lock(shard.streams_mutex);
+  shard.streams.erase(stream);
+}
+
+void JitterBufferPool::Enqueue(const StreamId stream, const Packet *packets, const std::size_t count) {
+  Shard &shard = ShardFor(stream);
+
+  // Claim the next position, once the worker is done with its slot.
+  std::size_t position = shard.enqueue_position.load(std::memory_order_relaxed);
+  Slot *slot;
+  while (true) {
+    slot = &shard.slots[position % INGRESS_SLOTS];
+    const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (shard.enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else {
+      if (sequence < position) {
+        // Full: the slot still holds a call from the last lap.
+        std::this_thread::yield();
+      }
+      position = shard.enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->stream = stream;
+  slot->packets.clear();
+  slot->bytes.clear();
+  for (std::size_t index = 0; index < count; index++) {
+    const Packet &packet = packets[index];
+    const auto *data = static_cast<const std::uint8_t *>(packet.data);
+    const std::size_t offset = slot->bytes.size();
+    slot->bytes.insert(slot->bytes.end(), data, data + packet.length);
+    slot->packets.push_back(Ingress{
+            .sequence_number = packet.sequence_number,
+            .elements = packet.elements,
+            .offset = offset,
+            .length = packet.length,
+    });
+  }
+
+  // Publishing and the worker going to sleep are sequentially consistent, so either the worker sees this slot before
+  // it sleeps, or this sees it asleep and wakes it.
+  slot->sequence.store(position + 1, std::memory_order_seq_cst);
+  if (shard.sleeping.load(std::memory_order_seq_cst)) {
+    {
+      std::lock_guard<std::mutex> lock(shard.wake_mutex);
+    }
+    shard.wake.notify_one();
+  }
+}
+
+const std::vector<JitterBufferPool::Dequeued> &JitterBufferPool::DequeueAll(const std::size_t elements) {
+  {
+    std::lock_guard<std::mutex> lock(done_mutex);
+    ticks_outstanding = shards.size();
+  }
+  for (const auto &shard: shards) {
+    {
+      std::lock_guard<std::mutex> lock(shard->wake_mutex);
+      shard->tick = true;
+      shard->tick_elements = elements;
+    }
+    shard->wake.notify_one();
+  }
+  {
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [this]() { return ticks_outstanding == 0; });
+  }
+
+  dequeued.clear();
+  for (const auto &shard: shards) {
+    dequeued.insert(dequeued.end(), shard->dequeued.begin(), shard->dequeued.end());
+  }
+  return dequeued;
+}
+
+Metrics JitterBufferPool::GetMetrics(const StreamId stream) const {
+  const Shard &shard = ShardFor(stream);
+  std::lock_guard<std::mutex> lock(shard.streams_mutex);
+  const auto found = shard.streams.find(stream);
+  if (found == shard.streams.end()) {
+    std::ostringstream message;
+    message << "Unknown stream: " << stream;
+    throw std::invalid_argument(message.str());
+  }
+  return found->second.buffer->GetMetrics();
+}
+
+JitterBufferPool::Shard &JitterBufferPool::ShardFor(const StreamId stream) const {
+  return *shards[stream % shards.size()];
+}
+
+void JitterBufferPool::Work(Shard &shard) {
+  std::unique_lock<std::mutex> lock(shard.wake_mutex);
+  while (true) {
+    shard.sleeping.store(true, std::memory_order_seq_cst);
+    shard.wake.wait(lock, [&shard]() {
+      const Slot &next = shard.slots[shard.dequeue_position % INGRESS_SLOTS];
+      return shard.stop || shard.tick || next.sequence.load(std::memory_order_seq_cst) == shard.dequeue_position + 1;
+    });
+    shard.sleeping.store(false, std::memory_order_relaxed);
+    if (shard.stop) {
+      return;
+    }
+    const bool tick = shard.tick;
+    const std::size_t elements = shard.tick_elements;
+    shard.tick = false;
+    lock.unlock();
+
+    Apply(shard);
+    if (tick) {
+      Tick(shard, elements);
+      std::lock_guard<std::mutex> done_lock(done_mutex);
+      if (--ticks_outstanding == 0) {
+        done.notify_one();
+      }
+    }
+    lock.lock();
+  }
+}
+
+void JitterBufferPool::Apply(Shard &shard) {
+  std::lock_guard<std::mutex> lock(shard.streams_mutex);
+  // Take everything queued so far, while producers carry on filling the slots after it.
+  const std::size_t last = shard.enqueue_position.load(std::memory_order_relaxed);
+  while (shard.dequeue_position < last) {
+    // Stop at the first slot still being filled.
+    const Slot &first = shard.slots[shard.dequeue_position % INGRESS_SLOTS];
+    if (first.sequence.load(std::memory_order_acquire) != shard.dequeue_position + 1) {
+      return;
+    }
+
+    // Enqueue consecutive calls for the same stream together.
+    const StreamId id = first.stream;
+    std::size_t end = shard.dequeue_position;
+    shard.run.clear();
+    for (; end < last; end++) {
+      Slot &slot = shard.slots[end % INGRESS_SLOTS];
+      if (slot.sequence.load(std::memory_order_acquire) != end + 1 || slot.stream != id) {
+        break;
+      }
+      for (const Ingress &ingress: slot.packets) {
+        shard.run.push_back(Packet{
+                .sequence_number = ingress.sequence_number,
+                .data = slot.bytes.data() + ingress.offset,
+                .length = ingress.length,
+                .elements = ingress.elements,
+        });
+      }
+    }
+
+    const auto found = shard.streams.find(id);
+    if (found == shard.streams.end()) {
+      logger->warning << "Dropping " << shard.run.size() << " packets for unknown stream: " << id << std::flush;
+    } else {
+      try {
+        found->second.buffer->Enqueue(shard.run.data(), shard.run.size(), [this, id](const std::span<Packet> packets) {
+          concealment_callback(id, packets);
+        });
+      } catch (const std::exception &ex) {
+        logger->warning << "Failed to enqueue to stream " << id << ": " << ex.what() << std::flush;
+      }
+    }
+
+    // Hand the slots back to producers for their next lap.
+    for (; shard.dequeue_position < end; shard.dequeue_position++) {
+      shard.slots[shard.dequeue_position % INGRESS_SLOTS].sequence.store(shard.dequeue_position + INGRESS_SLOTS, std::memory_order_release);
+    }
+  }
+}
+
+void JitterBufferPool::Tick(Shard &shard, const std::size_t elements) {
+  std::lock_guard<std::mutex> lock(shard.streams_mutex);
+  shard.dequeued.clear();
+  for (auto &[id, stream]: shard.streams) {
+    const std::size_t bytes = elements * stream.buffer->GetElementSize();
+    if (stream.output.size() < bytes) {
+      stream.output.resize(bytes);
+    }
+    const std::size_t got = stream.buffer->Dequeue(stream.output.data(), stream.output.size(), elements);
+    if (got > 0) {
+      shard.dequeued.push_back(Dequeued{.stream = id, .data = stream.output.data(), .elements = got});
+    }
+  }
+}
+
+void JitterBufferPool::Pin([[maybe_unused]] std::thread &thread, [[maybe_unused]] const std::size_t core) {
+#ifdef __linux__
+  const std::size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core % cores, &set);
+  pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+}
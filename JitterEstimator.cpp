@@ -0,0 +1,96 @@
+#include "JitterEstimator.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace std::chrono;
+
+JitterEstimator::JitterEstimator(const nanoseconds packet_duration, const milliseconds max_delay, const float quantile)
+    : packet_duration(packet_duration),
+      quantile(quantile),
+      jitter(0),
+      current_minimum(std::numeric_limits<std::int64_t>::max()),
+      previous_minimum(std::numeric_limits<std::int64_t>::max()),
+      window_arrivals(0),
+      histogram(max_delay.count() + 1, 0),
+      weight(1),
+      total_weight(0),
+      quantile_index(0),
+      below_quantile(0),
+      delay(0) {
+  if (packet_duration.count() <= 0) {
+    throw std::invalid_argument("Packet duration must be positive.");
+  }
+  if (quantile <= 0 || quantile > 1) {
+    throw std::invalid_argument("Quantile must be in (0, 1].");
+  }
+}
+
+void JitterEstimator::Arrival(const std::uint32_t sequence_number, const nanoseconds now) {
+  Arrival(static_cast<std::int64_t>(sequence_number) * packet_duration, now);
+}
+
+void JitterEstimator::Arrival(const nanoseconds media_time, const nanoseconds now) {
+  // How long this packet took to get here, relative to when it should have.
+  const std::int64_t transit = (now - media_time).count();
+
+  // RFC 3550 interarrival jitter.
+  if (last_transit.has_value()) {
+    const double difference = std::abs(static_cast<double>(transit - last_transit.value()));
+    jitter += (difference - jitter) / 16;
+  }
+  last_transit = transit;
+
+  // The fastest packet over the last one to two windows is the baseline, so the baseline can follow clock drift.
+  current_minimum = std::min(current_minimum, transit);
+  if (++window_arrivals == WINDOW_PACKETS) {
+    previous_minimum = current_minimum;
+    current_minimum = std::numeric_limits<std::int64_t>::max();
+    window_arrivals = 0;
+  }
+  const std::int64_t baseline = std::min(current_minimum, previous_minimum);
+  const std::int64_t relative_delay = transit - baseline;
+
+  // Add to the histogram. Rather than decaying every bucket, newer samples weigh progressively more.
+  const std::size_t bucket = std::min(static_cast<std::size_t>(duration_cast<milliseconds>(nanoseconds(relative_delay)).count()), histogram.size() - 1);
+  weight /= FORGET_FACTOR;
+  histogram[bucket] += weight;
+  total_weight += weight;
+  if (bucket < quantile_index) {
+    below_quantile += weight;
+  }
+  if (weight > 1e100) {
+    below_quantile = 0;
+    for (std::size_t index = 0; index < histogram.size(); index++) {
+      histogram[index] /= weight;
+      if (index < quantile_index) {
+        below_quantile += histogram[index];
+      }
+    }
+    total_weight /= weight;
+    weight = 1;
+  }
+
+  // Move to the first bucket whose cumulative weight covers the wanted quantile. One sample only shifts the quantile
+  // a little, so this takes a few steps rather than a walk of the whole histogram.
+  const double wanted = total_weight * quantile;
+  while (quantile_index < histogram.size() - 1 && below_quantile + histogram[quantile_index] < wanted) {
+    below_quantile += histogram[quantile_index];
+    quantile_index++;
+  }
+  while (quantile_index > 0 && below_quantile >= wanted) {
+    quantile_index--;
+    below_quantile -= histogram[quantile_index];
+  }
+  delay = milliseconds(quantile_index);
+}
+
+nanoseconds JitterEstimator::GetJitter() const {
+  return nanoseconds(static_cast<std::int64_t>(jitter));
+}
+
+milliseconds JitterEstimator::GetDelay() const {
+  return delay;
+}
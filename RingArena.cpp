@@ -0,0 +1,206 @@
+#include "RingArena.hh"
+#include "JitterBuffer.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#elif _GNU_SOURCE
+#include <linux/memfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if _GNU_SOURCE && !defined(__APPLE__)
+namespace {
+/// @brief True if the kernel may back shared memory with transparent huge pages when advised to.
+bool TransparentHugeShmem() {
+  std::ifstream setting("/sys/kernel/mm/transparent_hugepage/shmem_enabled");
+  std::string value;
+  std::getline(setting, value);
+  return value.find("[never]") == std::string::npos && value.find("[deny]") == std::string::npos && !value.empty();
+}
+}// namespace
+#endif
+
+RingArena::RingArena(const std::size_t region_size, [[maybe_unused]] const bool huge_pages)
+    : region_size(region_size),
+      backing(RingBacking::Standard) {
+#if _GNU_SOURCE && !defined(__APPLE__)
+  if (huge_pages) {
+    backing = RingBacking::Huge;
+  }
+#endif
+}
+
+RingArena::~RingArena() {
+#ifdef __APPLE__
+  for (const Mapping &mapping : mappings) {
+    VirtualMemory::Free(mapping.address, mapping.length / 2, nullptr);
+  }
+#elif _GNU_SOURCE
+  for (const Mapping &mapping : mappings) {
+    munmap(mapping.address, mapping.length);
+  }
+  for (const Region &region : regions) {
+    close(region.fd);
+  }
+#endif
+}
+
+Ring RingArena::Allocate(std::size_t length) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const RingBacking wanted = BackingFor(length);
+  const std::size_t granularity = Granularity(wanted);
+  length = (length + granularity - 1) / granularity * granularity;
+  auto found = free_rings.find(length);
+  if (found != free_rings.end() && !found->second.empty()) {
+    const Ring ring = found->second.back();
+    found->second.pop_back();
+    return ring;
+  }
+  return Map(length, wanted);
+}
+
+void RingArena::Release(const Ring &ring) {
+  std::lock_guard<std::mutex> lock(mutex);
+  free_rings[ring.length].push_back(ring);
+}
+
+RingBacking RingArena::GetBacking() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return backing;
+}
+
+std::size_t RingArena::GetRegions() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return regions.size();
+}
+
+std::size_t RingArena::GetFreeRings() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::size_t count = 0;
+  for (const auto &[length, rings] : free_rings) {
+    count += rings.size();
+  }
+  return count;
+}
+
+RingBacking RingArena::BackingFor(const std::size_t length) const {
+  // Each half of a ring is mapped on its own page boundary, so anything less than a huge page would waste the rest.
+  return length >= HUGE_PAGE_SIZE ? backing : RingBacking::Standard;
+}
+
+std::size_t RingArena::Granularity(const RingBacking ring_backing) {
+  // Huge page mappings must start and end on huge page boundaries, in memory and in the file.
+  if (ring_backing != RingBacking::Standard) {
+    return HUGE_PAGE_SIZE;
+  }
+#ifdef __APPLE__
+  return vm_page_size;
+#elif _GNU_SOURCE
+  return getpagesize();
+#else
+  return 1;
+#endif
+}
+
+Ring RingArena::Map(const std::size_t length, [[maybe_unused]] const RingBacking wanted) {
+  // Make room in the bookkeeping first, so a failure after mapping can't leak it.
+  mappings.reserve(mappings.size() + 1);
+#ifdef __APPLE__
+  // Mach remaps anonymous memory directly, so there are no regions to carve from; rings are only recycled.
+  std::size_t mapped = length;
+  auto *address = static_cast<std::uint8_t *>(VirtualMemory::Make(mapped, nullptr));
+  mappings.push_back({address, mapped * 2});
+  return {address, mapped, RingBacking::Standard};
+#elif _GNU_SOURCE
+  Region &region = RegionFor(length, wanted);
+
+  // Reserve both halves, aligned for the region's pages, then map the same slice of the region into each.
+  const std::size_t alignment = region.backing == RingBacking::Standard ? 0 : HUGE_PAGE_SIZE;
+  const std::size_t reserved = 2 * length + alignment;
+  void *reservation = mmap(nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (reservation == MAP_FAILED) {
+    throw std::runtime_error("Failed to reserve ring address space");
+  }
+  auto *address = static_cast<std::uint8_t *>(reservation);
+  if (alignment > 0) {
+    const auto unaligned = reinterpret_cast<std::uintptr_t>(address);
+    address += (alignment - unaligned % alignment) % alignment;
+  }
+  const auto offset = static_cast<off_t>(region.used);
+  if (mmap(address, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, region.fd, offset) == MAP_FAILED ||
+      mmap(address + length, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, region.fd, offset) == MAP_FAILED) {
+    munmap(reservation, reserved);
+    throw std::runtime_error("Failed to map ring");
+  }
+  RingBacking ring_backing = region.backing;
+  if (ring_backing == RingBacking::TransparentHuge && madvise(address, 2 * length, MADV_HUGEPAGE) != 0) {
+    ring_backing = RingBacking::Standard;
+  }
+  region.used += length;
+  mappings.push_back({static_cast<std::uint8_t *>(reservation), reserved});
+  return {address, length, ring_backing};
+#else
+  (void)length;
+  throw std::runtime_error("No virtual memory implementation");
+#endif
+}
+
+#if _GNU_SOURCE && !defined(__APPLE__)
+RingArena::Region &RingArena::RegionFor(const std::size_t length, RingBacking wanted) {
+  // Rings of each backing are carved from the newest region of that backing.
+  for (auto region = regions.rbegin(); region != regions.rend(); ++region) {
+    if (region->backing == wanted) {
+      if (region->size - region->used >= length) {
+        return *region;
+      }
+      break;
+    }
+  }
+
+  // Fall back a step at a time from what was asked for, until a region can be made.
+  regions.reserve(regions.size() + 1);
+  while (true) {
+    const std::size_t granularity = Granularity(wanted);
+    const std::size_t size = (std::max(region_size, length) + granularity - 1) / granularity * granularity;
+    const unsigned int flags = wanted == RingBacking::Huge ? MFD_HUGETLB | MFD_HUGE_2MB : 0;
+    const int fd = memfd_create("ring_arena", flags);
+    bool made = fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) == 0;
+    if (made && wanted == RingBacking::Huge) {
+      // Huge pages are reserved on first mapping, which fails if the pool can't cover the region.
+      void *probe = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      made = probe != MAP_FAILED;
+      if (made) {
+        munmap(probe, size);
+      }
+    }
+    if (made) {
+      regions.push_back({fd, size, 0, wanted});
+      return regions.back();
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    switch (wanted) {
+      case RingBacking::Huge:
+        wanted = TransparentHugeShmem() ? RingBacking::TransparentHuge : RingBacking::Standard;
+        backing = wanted;
+        break;
+      case RingBacking::TransparentHuge:
+        wanted = RingBacking::Standard;
+        backing = wanted;
+        break;
+      case RingBacking::Standard: {
+        std::ostringstream error;
+        error << "Failed to create ring arena region of " << size << " bytes";
+        throw std::runtime_error(error.str());
+      }
+    }
+  }
+}
+#endif
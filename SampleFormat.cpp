@@ -0,0 +1,232 @@
+#include "SampleFormat.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+template<SampleType Type>
+float Decode(const std::uint8_t *samples, std::size_t index);
+
+template<>
+float Decode<SampleType::Int16>(const std::uint8_t *samples, const std::size_t index) {
+  return static_cast<float>(reinterpret_cast<const std::int16_t *>(samples)[index]) * (1.0F / 32768.0F);
+}
+
+template<>
+float Decode<SampleType::Int24>(const std::uint8_t *samples, const std::size_t index) {
+  const std::uint8_t *sample = samples + (index * 3);
+  // Assemble in the top of 32 bits, then shift back down to sign extend.
+  const auto value = static_cast<std::int32_t>((static_cast<std::uint32_t>(sample[0]) << 8) | (static_cast<std::uint32_t>(sample[1]) << 16) | (static_cast<std::uint32_t>(sample[2]) << 24)) >> 8;
+  return static_cast<float>(value) * (1.0F / 8388608.0F);
+}
+
+template<>
+float Decode<SampleType::Float32>(const std::uint8_t *samples, const std::size_t index) {
+  return reinterpret_cast<const float *>(samples)[index];
+}
+
+/// @brief Scale to an integer range, round to nearest, and clip.
+template<std::int32_t Scale>
+std::int32_t Quantize(const float value) {
+  // Rounding away from zero before clipping, then truncating, keeps this free of branches.
+  const float rounded = (value * static_cast<float>(Scale)) + std::copysign(0.5F, value);
+  return static_cast<std::int32_t>(std::min(std::max(rounded, -static_cast<float>(Scale)), static_cast<float>(Scale - 1)));
+}
+
+template<SampleType Type>
+void Encode(std::uint8_t *samples, std::size_t index, float value);
+
+template<>
+void Encode<SampleType::Int16>(std::uint8_t *samples, const std::size_t index, const float value) {
+  reinterpret_cast<std::int16_t *>(samples)[index] = static_cast<std::int16_t>(Quantize<32768>(value));
+}
+
+template<>
+void Encode<SampleType::Int24>(std::uint8_t *samples, const std::size_t index, const float value) {
+  const auto quantized = static_cast<std::uint32_t>(Quantize<8388608>(value));
+  std::uint8_t *sample = samples + (index * 3);
+  sample[0] = static_cast<std::uint8_t>(quantized);
+  sample[1] = static_cast<std::uint8_t>(quantized >> 8);
+  sample[2] = static_cast<std::uint8_t>(quantized >> 16);
+}
+
+template<>
+void Encode<SampleType::Float32>(std::uint8_t *samples, const std::size_t index, const float value) {
+  reinterpret_cast<float *>(samples)[index] = value;
+}
+
+/// @brief Convert count samples, a fixed distance apart on each side. A step of 0 means the runtime one.
+template<SampleType From, SampleType To, std::size_t SourceStep, std::size_t DestinationStep>
+void Run(const std::uint8_t *source, const std::size_t source_step, std::uint8_t *destination, const std::size_t destination_step, const std::size_t count) {
+  const std::size_t from_step = SourceStep != 0 ? SourceStep : source_step;
+  const std::size_t to_step = DestinationStep != 0 ? DestinationStep : destination_step;
+  for (std::size_t index = 0; index < count; index++) {
+    Encode<To>(destination, index * to_step, Decode<From>(source, index * from_step));
+  }
+}
+
+template<SampleType From, SampleType To>
+void Dispatch(const std::uint8_t *source, const std::size_t source_step, std::uint8_t *destination, const std::size_t destination_step, const std::size_t count) {
+  // Contiguous runs, and stereo (de)interleaving, get strides the compiler can see.
+  if (source_step == 1 && destination_step == 1) {
+    Run<From, To, 1, 1>(source, 1, destination, 1, count);
+  } else if (source_step == 2 && destination_step == 1) {
+    Run<From, To, 2, 1>(source, 2, destination, 1, count);
+  } else if (source_step == 1 && destination_step == 2) {
+    Run<From, To, 1, 2>(source, 1, destination, 2, count);
+  } else {
+    Run<From, To, 0, 0>(source, source_step, destination, destination_step, count);
+  }
+}
+
+template<SampleType Type>
+void Interpolate(const std::uint8_t *source, const std::size_t channels, const double position, const double step, std::uint8_t *destination, const std::size_t elements) {
+  for (std::size_t element = 0; element < elements; element++) {
+    const double at = position + (static_cast<double>(element) * step);
+    const auto index = static_cast<std::size_t>(at);
+    const auto fraction = static_cast<float>(at - static_cast<double>(index));
+    const std::size_t first = (index - 1) * channels;
+    // Channels of an element are contiguous, so the inner loop runs across them.
+    for (std::size_t channel = 0; channel < channels; channel++) {
+      const float before = Decode<Type>(source, first + channel);
+      const float from = Decode<Type>(source, first + channels + channel);
+      const float to = Decode<Type>(source, first + (2 * channels) + channel);
+      const float after = Decode<Type>(source, first + (3 * channels) + channel);
+      // Catmull-Rom: passes through from and to, with slopes taken from their neighbours.
+      const float a = (-0.5F * before) + (1.5F * from) - (1.5F * to) + (0.5F * after);
+      const float b = before - (2.5F * from) + (2 * to) - (0.5F * after);
+      const float c = 0.5F * (to - before);
+      Encode<Type>(destination, (element * channels) + channel, (((((a * fraction) + b) * fraction) + c) * fraction) + from);
+    }
+  }
+}
+
+using Kernel = void (*)(const std::uint8_t *, std::size_t, std::uint8_t *, std::size_t, std::size_t);
+
+template<SampleType From>
+Kernel Select(const SampleType to) {
+  switch (to) {
+    case SampleType::Int16:
+      return &Dispatch<From, SampleType::Int16>;
+    case SampleType::Int24:
+      return &Dispatch<From, SampleType::Int24>;
+    case SampleType::Float32:
+      return &Dispatch<From, SampleType::Float32>;
+  }
+  throw std::invalid_argument("Unknown sample type");
+}
+
+Kernel Select(const SampleType from, const SampleType to) {
+  switch (from) {
+    case SampleType::Int16:
+      return Select<SampleType::Int16>(to);
+    case SampleType::Int24:
+      return Select<SampleType::Int24>(to);
+    case SampleType::Float32:
+      return Select<SampleType::Float32>(to);
+  }
+  throw std::invalid_argument("Unknown sample type");
+}
+}// namespace
+
+std::size_t SampleFormat::GetSampleSize() const {
+  switch (type) {
+    case SampleType::Int16:
+      return 2;
+    case SampleType::Int24:
+      return 3;
+    case SampleType::Float32:
+      return 4;
+  }
+  throw std::invalid_argument("Unknown sample type");
+}
+
+std::size_t SampleFormat::GetElementSize() const {
+  return GetSampleSize() * channels;
+}
+
+void ConvertSamples(const std::uint8_t *source, const SampleFormat &source_format, const std::size_t source_plane_elements,
+                    std::uint8_t *destination, const SampleFormat &destination_format, const std::size_t destination_plane_elements,
+                    const std::size_t elements) {
+  if (source_format.channels != destination_format.channels || source_format.channels == 0) {
+    std::ostringstream message;
+    message << "Channel counts must match. Was: " << source_format.channels << ", and: " << destination_format.channels;
+    throw std::invalid_argument(message.str());
+  }
+  const std::size_t channels = source_format.channels;
+  const bool source_planar = source_format.layout == SampleLayout::Planar;
+  const bool destination_planar = destination_format.layout == SampleLayout::Planar;
+
+  // Same layout with nothing in between planes is one contiguous run.
+  const bool contiguous = channels == 1 ||
+                          (!source_planar && !destination_planar) ||
+                          (source_planar && destination_planar && source_plane_elements == elements && destination_plane_elements == elements);
+  if (contiguous && source_format.type == destination_format.type) {
+    memcpy(destination, source, elements * source_format.GetElementSize());
+    return;
+  }
+  const Kernel kernel = Select(source_format.type, destination_format.type);
+  if (contiguous) {
+    kernel(source, 1, destination, 1, elements * channels);
+    return;
+  }
+
+  // Otherwise, a channel at a time.
+  const std::size_t source_sample = source_format.GetSampleSize();
+  const std::size_t destination_sample = destination_format.GetSampleSize();
+  for (std::size_t channel = 0; channel < channels; channel++) {
+    const std::uint8_t *from = source + (channel * source_sample * (source_planar ? source_plane_elements : 1));
+    std::uint8_t *to = destination + (channel * destination_sample * (destination_planar ? destination_plane_elements : 1));
+    kernel(from, source_planar ? 1 : channels, to, destination_planar ? 1 : channels, elements);
+  }
+}
+
+void MixSamples(const std::uint8_t *source, const SampleType type, const float gain, std::uint8_t *destination, const std::size_t samples) {
+  switch (type) {
+    case SampleType::Int16: {
+      const auto *from = reinterpret_cast<const std::int16_t *>(source);
+      auto *to = reinterpret_cast<std::int16_t *>(destination);
+      for (std::size_t index = 0; index < samples; index++) {
+        const float sum = static_cast<float>(to[index]) + (static_cast<float>(from[index]) * gain);
+        const float rounded = sum + std::copysign(0.5F, sum);
+        to[index] = static_cast<std::int16_t>(std::min(std::max(rounded, -32768.0F), 32767.0F));
+      }
+      return;
+    }
+    case SampleType::Float32: {
+      const auto *from = reinterpret_cast<const float *>(source);
+      auto *to = reinterpret_cast<float *>(destination);
+      for (std::size_t index = 0; index < samples; index++) {
+        to[index] += from[index] * gain;
+      }
+      return;
+    }
+    case SampleType::Int24:
+      break;
+  }
+  throw std::invalid_argument("Only int16 and float samples can be mixed");
+}
+
+void InterpolateSamples(const std::uint8_t *source, const SampleFormat &format, const double position, const double step, std::uint8_t *destination, const std::size_t elements) {
+  if (format.layout != SampleLayout::Interleaved) {
+    throw std::invalid_argument("Only interleaved samples can be interpolated");
+  }
+  if (position < 1) {
+    throw std::invalid_argument("Position must leave an element before it");
+  }
+  switch (format.type) {
+    case SampleType::Int16:
+      Interpolate<SampleType::Int16>(source, format.channels, position, step, destination, elements);
+      return;
+    case SampleType::Int24:
+      Interpolate<SampleType::Int24>(source, format.channels, position, step, destination, elements);
+      return;
+    case SampleType::Float32:
+      Interpolate<SampleType::Float32>(source, format.channels, position, step, destination, elements);
+      return;
+  }
+  throw std::invalid_argument("Unknown sample type");
+}
@@ -0,0 +1,134 @@
+#include "TimeStretch.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+template<typename Sample>
+Wsola<Sample>::Wsola(const std::size_t channels, const std::uint32_t clock_rate)
+    : channels(channels),
+      min_period(clock_rate / 400),
+      max_period(clock_rate / 50),
+      overlap(clock_rate / 200) {
+  if (channels == 0) {
+    throw std::invalid_argument("Channels must be at least 1.");
+  }
+  if (min_period == 0) {
+    throw std::invalid_argument("Clock rate too low to time stretch.");
+  }
+}
+
+template<typename Sample>
+std::size_t Wsola<Sample>::operator()(const std::uint8_t *source, const std::size_t source_elements, std::uint8_t *destination, const std::size_t destination_elements) const {
+  const auto *input = reinterpret_cast<const Sample *>(source);
+  auto *output = reinterpret_cast<Sample *>(destination);
+  const std::size_t element_size = channels * sizeof(Sample);
+  const std::size_t length = std::min(overlap, destination_elements);
+
+  if (source_elements > destination_elements) {
+    // Accelerate: crossfade the start into a period later, then carry on from there.
+    const std::size_t last = std::min(max_period, source_elements - destination_elements);
+    if (length > 0 && last >= min_period) {
+      double correlation;
+      const std::size_t period = FindPeriod(input, min_period, last, length, correlation);
+      if (correlation >= MIN_CORRELATION) {
+        Crossfade(input, input + (period * channels), output, length);
+        memcpy(output + (length * channels), input + ((period + length) * channels), (destination_elements - length) * element_size);
+        return destination_elements + period;
+      }
+    }
+  } else {
+    // Decelerate: play a period, crossfade back to the start, then play it again.
+    const std::size_t available = std::min(source_elements, destination_elements);
+    const std::size_t last = available > length ? std::min(max_period, available - length) : 0;
+    if (length > 0 && last >= min_period) {
+      double correlation;
+      const std::size_t period = FindPeriod(input, min_period, last, length, correlation);
+      if (correlation >= MIN_CORRELATION) {
+        memcpy(output, input, period * element_size);
+        Crossfade(input + (period * channels), input, output + (period * channels), length);
+        memcpy(output + ((period + length) * channels), input + (length * channels), (destination_elements - period - length) * element_size);
+        return destination_elements - period;
+      }
+    }
+  }
+
+  // Nothing suitable, pass through.
+  const std::size_t copied = std::min(source_elements, destination_elements);
+  memcpy(output, input, copied * element_size);
+  return copied;
+}
+
+template<typename Sample>
+std::size_t Wsola<Sample>::GetLookahead() const {
+  return max_period;
+}
+
+template<typename Sample>
+std::size_t Wsola<Sample>::FindPeriod(const Sample *source, const std::size_t first, const std::size_t last, const std::size_t length, double &correlation) const {
+  // Coarse search, then refine around the best candidate.
+  correlation = -std::numeric_limits<double>::infinity();
+  std::size_t best = first;
+  for (std::size_t period = first; period <= last; period += SEARCH_STEP) {
+    const double candidate = Correlation(source, source + (period * channels), length);
+    if (candidate > correlation) {
+      correlation = candidate;
+      best = period;
+    }
+  }
+  const std::size_t coarse = best;
+  const std::size_t from = coarse > first + SEARCH_STEP ? coarse - SEARCH_STEP + 1 : first;
+  const std::size_t to = std::min(coarse + SEARCH_STEP - 1, last);
+  for (std::size_t period = from; period <= to; period++) {
+    const double candidate = Correlation(source, source + (period * channels), length);
+    if (candidate > correlation) {
+      correlation = candidate;
+      best = period;
+    }
+  }
+  return best;
+}
+
+template<typename Sample>
+double Wsola<Sample>::Correlation(const Sample *a, const Sample *b, const std::size_t elements) const {
+  double cross = 0;
+  double energy_a = 0;
+  double energy_b = 0;
+  for (std::size_t index = 0; index < elements * channels; index++) {
+    const double sample_a = a[index];
+    const double sample_b = b[index];
+    cross += sample_a * sample_b;
+    energy_a += sample_a * sample_a;
+    energy_b += sample_b * sample_b;
+  }
+  if (energy_a == 0 && energy_b == 0) {
+    // Silence splices perfectly.
+    return 1;
+  }
+  if (energy_a == 0 || energy_b == 0) {
+    return 0;
+  }
+  return cross / std::sqrt(energy_a * energy_b);
+}
+
+template<typename Sample>
+void Wsola<Sample>::Crossfade(const Sample *out, const Sample *in, Sample *destination, const std::size_t elements) const {
+  for (std::size_t element = 0; element < elements; element++) {
+    const float gain = static_cast<float>(element + 1) / static_cast<float>(elements + 1);
+    for (std::size_t channel = 0; channel < channels; channel++) {
+      const std::size_t index = (element * channels) + channel;
+      const float mixed = (out[index] * (1 - gain)) + (in[index] * gain);
+      if constexpr (std::is_integral_v<Sample>) {
+        destination[index] = static_cast<Sample>(std::lround(mixed));
+      } else {
+        destination[index] = mixed;
+      }
+    }
+  }
+}
+
+template class Wsola<std::int16_t>;
+template class Wsola<float>;
@@ -1,19 +1,28 @@
+#include <Concealment.hh>
 #include <JitterBuffer.hh>
+#include <JitterBufferPool.hh>
 #include <benchmark/benchmark.h>
+#include <atomic>
+#include <barrier>
 #include <cassert>
 #include <iostream>
 #include <memory>
+#include <thread>
 
 std::unique_ptr<JitterBuffer> buffer;
 void *data;
 const std::size_t frame_size = 1;
 const std::size_t frames_per_packet = 480;
 
+const std::chrono::milliseconds max_time = std::chrono::milliseconds(10000);
+
 static void DoSetup(const benchmark::State &state) {
   const std::size_t sample_rate = 48000;
-  const std::chrono::milliseconds max_time = std::chrono::milliseconds(10000);
   const std::chrono::milliseconds min_time = std::chrono::milliseconds(0);
-  buffer = std::make_unique<JitterBuffer>(frame_size, frames_per_packet, sample_rate, max_time, min_time, std::make_shared<cantina::Logger>("", ""));
+  // Time stands still, so results don't depend on how long iterations take.
+  buffer = std::make_unique<JitterBuffer>(frame_size, frames_per_packet, sample_rate, max_time, min_time, std::make_shared<cantina::Logger>("", ""), []() {
+    return std::chrono::nanoseconds(0);
+  });
   data = malloc(frame_size * frames_per_packet);
 }
 
@@ -22,14 +31,26 @@ static void DoTeardown(const benchmark::State &state) {
   free(data);
 }
 
+// Time doesn't pass, so empty the buffer outside the timed region before it fills.
+static void Drain(benchmark::State &state) {
+  if (buffer->GetCurrentDepth() < max_time / 2) {
+    return;
+  }
+  state.PauseTiming();
+  std::vector<std::uint8_t> destination(frame_size * frames_per_packet * 100);
+  while (buffer->Dequeue(destination.data(), destination.size(), destination.size() / frame_size) > 0) {
+  }
+  state.ResumeTiming();
+}
+
 static void libjitter_enqueue(benchmark::State &state) {
   std::size_t sequence_number = 0;
   for (auto _: state) {
     auto packet = Packet{
+            .sequence_number = sequence_number++,
             .data = data,
-            .elements = frames_per_packet,
             .length = frame_size * frames_per_packet,
-            .sequence_number = sequence_number++};
+            .elements = frames_per_packet};
     std::vector<Packet> packets = std::vector<Packet>();
     packets.push_back(packet);
     const std::size_t enqueued = buffer->Enqueue(
@@ -49,11 +70,12 @@ static void libjitter_concealment(benchmark::State &state) {
   std::size_t sequence_number = 0;
 
   for (auto _: state) {
+    Drain(state);
     auto packet = Packet{
+            .sequence_number = ++sequence_number,
             .data = data,
-            .elements = frames_per_packet,
             .length = frame_size * frames_per_packet,
-            .sequence_number = ++sequence_number};
+            .elements = frames_per_packet};
     std::vector<Packet> packets = std::vector<Packet>();
     packets.push_back(packet);
     const std::size_t enqueued = buffer->Enqueue(
@@ -67,10 +89,10 @@ static void libjitter_concealment(benchmark::State &state) {
     }
     sequence_number += state.range(0);
     auto next = Packet{
+            .sequence_number = sequence_number,
             .data = data,
-            .elements = frames_per_packet,
             .length = frame_size * frames_per_packet,
-            .sequence_number = sequence_number};
+            .elements = frames_per_packet};
     std::vector<Packet> nexts = std::vector<Packet>();
     nexts.push_back(next);
     const std::size_t concealed = buffer->Enqueue(
@@ -88,15 +110,201 @@ static void libjitter_concealment(benchmark::State &state) {
 }
 BENCHMARK(libjitter_concealment)->DenseRange(1, 20, 1)->Setup(DoSetup)->Teardown(DoTeardown)->Iterations(1000);
 
+static void libjitter_concealment_span(benchmark::State &state) {
+  std::size_t sequence_number = 0;
+
+  for (auto _: state) {
+    Drain(state);
+    const auto packet = Packet{
+            .sequence_number = ++sequence_number,
+            .data = data,
+            .length = frame_size * frames_per_packet,
+            .elements = frames_per_packet};
+    const std::size_t enqueued = buffer->Enqueue(
+            &packet,
+            1,
+            [](std::span<Packet>) {
+              assert(false);
+            });
+    if (enqueued == 0) {
+      state.SkipWithMessage("Full");
+      break;
+    }
+    sequence_number += state.range(0);
+    const auto next = Packet{
+            .sequence_number = sequence_number,
+            .data = data,
+            .length = frame_size * frames_per_packet,
+            .elements = frames_per_packet};
+    const std::size_t concealed = buffer->Enqueue(
+            &next,
+            1,
+            [](std::span<Packet> packets) {
+              for (Packet &packet: packets) {
+                memset(packet.data, 0, packet.length);
+              }
+            });
+    if (concealed == 0) {
+      state.SkipWithMessage("Full");
+      break;
+    }
+  }
+}
+BENCHMARK(libjitter_concealment_span)->DenseRange(1, 20, 1)->Setup(DoSetup)->Teardown(DoTeardown)->Iterations(1000);
+
+// Built in concealment of a 10ms mono packet, by strategy.
+static void libjitter_concealment_strategy(benchmark::State &state) {
+  const std::size_t elements = 480;
+  auto concealer = Concealer<std::int16_t>(static_cast<ConcealmentStrategy>(state.range(0)), 1, 48000);
+  std::vector<std::int16_t> history(elements * 4);
+  for (std::size_t index = 0; index < history.size(); index++) {
+    history[index] = static_cast<std::int16_t>((index % 240) * 100);
+  }
+  concealer.Observe(Packet{.sequence_number = 0, .data = history.data(), .length = history.size() * sizeof(std::int16_t), .elements = history.size()});
+  std::vector<std::int16_t> samples(elements);
+  Packet packet = {.sequence_number = 1, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = elements};
+  for (auto _: state) {
+    concealer(std::span<Packet>(&packet, 1));
+    benchmark::DoNotOptimize(samples.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * elements));
+}
+BENCHMARK(libjitter_concealment_strategy)->DenseRange(0, 3, 1);
+
+// Remembering 10ms mono packets as concealment source material.
+static void libjitter_concealment_observe(benchmark::State &state) {
+  const std::size_t elements = 480;
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::PitchRepetition, 1, 48000);
+  std::vector<std::int16_t> samples(elements, 1000);
+  const Packet packet = {.sequence_number = 0, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = elements};
+  for (auto _: state) {
+    concealer.Observe(packet);
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * elements));
+}
+BENCHMARK(libjitter_concealment_observe);
+
+// Dequeue 10ms of int16 stereo as planar float, converting on the way out (0) or in a second pass (1).
+static void libjitter_dequeue_convert(benchmark::State &state) {
+  const SampleFormat source_format = {SampleType::Int16, SampleLayout::Interleaved, 2};
+  const SampleFormat destination_format = {SampleType::Float32, SampleLayout::Planar, 2};
+  const std::size_t elements = 480;
+  auto converting = JitterBuffer(source_format.GetElementSize(), elements, 48000, std::chrono::milliseconds(100), std::chrono::milliseconds(0), std::make_shared<cantina::Logger>("", ""));
+  std::vector<std::int16_t> samples(elements * 2, 1000);
+  std::vector<std::uint8_t> raw(elements * source_format.GetElementSize());
+  std::vector<float> destination(elements * 2);
+  unsigned long sequence_number = 0;
+  for (auto _: state) {
+    const Packet packet = {.sequence_number = sequence_number++, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = elements};
+    converting.Enqueue(&packet, 1, [](std::span<Packet>) {});
+    auto *output = reinterpret_cast<std::uint8_t *>(destination.data());
+    if (state.range(0) == 0) {
+      converting.Dequeue(output, destination.size() * sizeof(float), elements, source_format, destination_format);
+    } else {
+      converting.Dequeue(raw.data(), raw.size(), elements);
+      ConvertSamples(raw.data(), source_format, 0, output, destination_format, elements, elements);
+    }
+    benchmark::DoNotOptimize(destination.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * elements));
+}
+BENCHMARK(libjitter_dequeue_convert)->Arg(0)->Arg(1);
+
+// Mix 10ms of int16 mono from range(0) buffers, with DequeueMix (0) or by dequeuing to scratch and summing (1).
+static void libjitter_dequeue_mix(benchmark::State &state) {
+  const std::size_t elements = 480;
+  std::vector<std::unique_ptr<JitterBuffer>> buffers;
+  std::vector<JitterBuffer::MixSource> sources;
+  for (std::int64_t source = 0; source < state.range(0); source++) {
+    buffers.push_back(std::make_unique<JitterBuffer>(sizeof(std::int16_t), elements, 48000, std::chrono::milliseconds(100), std::chrono::milliseconds(0), std::make_shared<cantina::Logger>("", "")));
+    sources.push_back({buffers.back().get(), 0.5F});
+  }
+  std::vector<std::int16_t> samples(elements, 1000);
+  std::vector<std::int16_t> scratch(elements);
+  std::vector<std::int16_t> destination(elements);
+  auto *output = reinterpret_cast<std::uint8_t *>(destination.data());
+  const std::size_t length = elements * sizeof(std::int16_t);
+  unsigned long sequence_number = 0;
+  for (auto _: state) {
+    const Packet packet = {.sequence_number = sequence_number++, .data = samples.data(), .length = length, .elements = elements};
+    for (const auto &buffer: buffers) {
+      buffer->Enqueue(&packet, 1, [](std::span<Packet>) {});
+    }
+    if (state.range(1) == 0) {
+      JitterBuffer::DequeueMix(sources, SampleType::Int16, output, length, elements);
+    } else {
+      memset(output, 0, length);
+      for (const auto &buffer: buffers) {
+        buffer->Dequeue(reinterpret_cast<std::uint8_t *>(scratch.data()), length, elements);
+        MixSamples(reinterpret_cast<std::uint8_t *>(scratch.data()), SampleType::Int16, 0.5F, output, elements);
+      }
+    }
+    benchmark::DoNotOptimize(destination.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * elements) * state.range(0));
+}
+BENCHMARK(libjitter_dequeue_mix)->ArgsProduct({{8, 32}, {0, 1}});
+
+// Conversion alone, over 10ms of stereo: int16 interleaved to float planar (0) and back (1).
+static void libjitter_convert_samples(benchmark::State &state) {
+  const SampleFormat interleaved = {SampleType::Int16, SampleLayout::Interleaved, 2};
+  const SampleFormat planar = {SampleType::Float32, SampleLayout::Planar, 2};
+  const std::size_t elements = 480;
+  std::vector<std::int16_t> samples(elements * 2, 1000);
+  std::vector<float> converted(elements * 2, 0.5F);
+  auto *integer = reinterpret_cast<std::uint8_t *>(samples.data());
+  auto *floating = reinterpret_cast<std::uint8_t *>(converted.data());
+  for (auto _: state) {
+    if (state.range(0) == 0) {
+      ConvertSamples(integer, interleaved, 0, floating, planar, elements, elements);
+    } else {
+      ConvertSamples(floating, planar, elements, integer, interleaved, 0, elements);
+    }
+    benchmark::DoNotOptimize(samples.data());
+    benchmark::DoNotOptimize(converted.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * elements * 2));
+}
+BENCHMARK(libjitter_convert_samples)->Arg(0)->Arg(1);
+
+// Mixing 10ms of stereo into an accumulator, int16 (0) and float (1).
+static void libjitter_mix_samples(benchmark::State &state) {
+  const std::size_t samples = 480 * 2;
+  const SampleType type = state.range(0) == 0 ? SampleType::Int16 : SampleType::Float32;
+  const std::size_t size = state.range(0) == 0 ? sizeof(std::int16_t) : sizeof(float);
+  std::vector<std::uint8_t> source(samples * size);
+  std::vector<std::uint8_t> destination(samples * size);
+  for (auto _: state) {
+    MixSamples(source.data(), type, 0.5F, destination.data(), samples);
+    benchmark::DoNotOptimize(destination.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * samples));
+}
+BENCHMARK(libjitter_mix_samples)->Arg(0)->Arg(1);
+
+// Resampling 10ms of stereo 200ppm fast, int16 (0) and float (1).
+static void libjitter_interpolate_samples(benchmark::State &state) {
+  const std::size_t elements = 480;
+  const SampleFormat format = {state.range(0) == 0 ? SampleType::Int16 : SampleType::Float32, SampleLayout::Interleaved, 2};
+  std::vector<std::uint8_t> source((elements + 4) * format.GetElementSize());
+  std::vector<std::uint8_t> destination(elements * format.GetElementSize());
+  for (auto _: state) {
+    InterpolateSamples(source.data(), format, 1, 1.0002, destination.data(), elements);
+    benchmark::DoNotOptimize(destination.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * elements * 2));
+}
+BENCHMARK(libjitter_interpolate_samples)->Arg(0)->Arg(1);
+
 static void libjitter_concealment_update(benchmark::State &state) {
   std::size_t sequence_number = 0;
 
   for (auto _: state) {
     auto packet = Packet{
+            .sequence_number = ++sequence_number,
             .data = data,
-            .elements = frames_per_packet,
             .length = frame_size * frames_per_packet,
-            .sequence_number = ++sequence_number};
+            .elements = frames_per_packet};
     std::vector<Packet> packets = std::vector<Packet>();
     packets.push_back(packet);
     const std::size_t enqueued = buffer->Enqueue(
@@ -110,10 +318,10 @@ static void libjitter_concealment_update(benchmark::State &state) {
     }
     sequence_number += state.range(0);
     auto next = Packet{
+            .sequence_number = sequence_number,
             .data = data,
-            .elements = frames_per_packet,
             .length = frame_size * frames_per_packet,
-            .sequence_number = sequence_number};
+            .elements = frames_per_packet};
     std::vector<Packet> nexts = std::vector<Packet>();
     nexts.push_back(next);
     const std::size_t concealed = buffer->Enqueue(
@@ -131,10 +339,10 @@ static void libjitter_concealment_update(benchmark::State &state) {
     // Update all the concealement packets with real data.
     for (unsigned long index = 2; index <= state.range() + 1; index++) {
         auto update = Packet{
+            .sequence_number = index,
             .data = data,
-            .elements = frames_per_packet,
             .length = frame_size * frames_per_packet,
-            .sequence_number = index};
+            .elements = frames_per_packet};
         std::vector<Packet> updates = std::vector<Packet>();
         updates.push_back(next);
         const std::size_t updated = buffer->Enqueue(
@@ -149,4 +357,131 @@ static void libjitter_concealment_update(benchmark::State &state) {
     }
   }
 }
-BENCHMARK(libjitter_concealment_update)->DenseRange(1, 20, 1)->Setup(DoSetup)->Teardown(DoTeardown)->Iterations(100);
\ No newline at end of file
+BENCHMARK(libjitter_concealment_update)->DenseRange(1, 20, 1)->Setup(DoSetup)->Teardown(DoTeardown)->Iterations(100);
+static void libjitter_pool(benchmark::State &state) {
+  const std::size_t streams = 256;
+  JitterBufferPool pool(state.range(0), [](JitterBufferPool::StreamId, std::span<Packet> packets) {
+    for (Packet &packet: packets) {
+      memset(packet.data, 0, packet.length);
+    }
+  }, std::make_shared<cantina::Logger>("", ""));
+  for (std::size_t stream = 0; stream < streams; stream++) {
+    pool.AddStream(frame_size, frames_per_packet, 48000, std::chrono::milliseconds(1000), std::chrono::milliseconds(0));
+  }
+  std::vector<std::uint8_t> payload(frame_size * frames_per_packet);
+
+  // Each iteration is one tick: a packet in and out of every stream.
+  unsigned long sequence_number = 0;
+  for (auto _: state) {
+    const auto packet = Packet{
+            .sequence_number = sequence_number++,
+            .data = payload.data(),
+            .length = payload.size(),
+            .elements = frames_per_packet};
+    for (JitterBufferPool::StreamId stream = 0; stream < streams; stream++) {
+      pool.Enqueue(stream, &packet, 1);
+    }
+    benchmark::DoNotOptimize(pool.DequeueAll(frames_per_packet).size());
+  }
+  state.SetItemsProcessed(state.iterations() * streams);
+}
+BENCHMARK(libjitter_pool)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+static void libjitter_pool_producers(benchmark::State &state) {
+  const std::size_t streams = 256;
+  const auto producers = static_cast<std::size_t>(state.range(0));
+  JitterBufferPool pool(4, [](JitterBufferPool::StreamId, std::span<Packet> packets) {
+    for (Packet &packet: packets) {
+      memset(packet.data, 0, packet.length);
+    }
+  }, std::make_shared<cantina::Logger>("", ""));
+  for (std::size_t stream = 0; stream < streams; stream++) {
+    pool.AddStream(frame_size, frames_per_packet, 48000, std::chrono::milliseconds(1000), std::chrono::milliseconds(0));
+  }
+  std::vector<std::uint8_t> payload(frame_size * frames_per_packet);
+
+  // Each tick, every producer enqueues to its share of the streams, all pushing to the same shards at once.
+  std::barrier start(static_cast<std::ptrdiff_t>(producers + 1));
+  std::barrier finish(static_cast<std::ptrdiff_t>(producers + 1));
+  bool running = true;
+  unsigned long sequence_number = 0;
+  std::vector<std::thread> threads;
+  for (std::size_t producer = 0; producer < producers; producer++) {
+    threads.emplace_back([&, producer]() {
+      while (true) {
+        start.arrive_and_wait();
+        if (!running) {
+          return;
+        }
+        const auto packet = Packet{
+                .sequence_number = sequence_number,
+                .data = payload.data(),
+                .length = payload.size(),
+                .elements = frames_per_packet};
+        for (std::size_t stream = producer; stream < streams; stream += producers) {
+          pool.Enqueue(static_cast<JitterBufferPool::StreamId>(stream), &packet, 1);
+        }
+        finish.arrive_and_wait();
+      }
+    });
+  }
+
+  for (auto _: state) {
+    start.arrive_and_wait();
+    finish.arrive_and_wait();
+    sequence_number++;
+    benchmark::DoNotOptimize(pool.DequeueAll(frames_per_packet).size());
+  }
+  running = false;
+  start.arrive_and_wait();
+  for (std::thread &thread: threads) {
+    thread.join();
+  }
+  state.SetItemsProcessed(state.iterations() * streams);
+}
+BENCHMARK(libjitter_pool_producers)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+static void libjitter_construct(benchmark::State &state) {
+  const auto logger = std::make_shared<cantina::Logger>("", "");
+  // Argument 1 takes rings from a shared arena, which only maps on the first iteration.
+  const auto arena = state.range(0) ? std::make_shared<RingArena>() : nullptr;
+  for (auto _: state) {
+    JitterBuffer constructed(frame_size, frames_per_packet, 48000, std::chrono::milliseconds(1000), std::chrono::milliseconds(0), logger, nullptr, arena);
+    benchmark::DoNotOptimize(constructed.GetCapacity());
+  }
+}
+BENCHMARK(libjitter_construct)->Arg(0)->Arg(1);
+
+static void libjitter_spsc(benchmark::State &state) {
+  // A network thread enqueues as fast as it can while this, the audio thread, dequeues.
+  JitterBuffer spsc(frame_size, frames_per_packet, 48000, max_time, std::chrono::milliseconds(0), std::make_shared<cantina::Logger>("", ""), []() {
+    return std::chrono::nanoseconds(0);
+  });
+  std::atomic<bool> running = true;
+  std::thread writer([&]() {
+    std::vector<std::uint8_t> payload(frame_size * frames_per_packet);
+    unsigned long sequence_number = 0;
+    while (running.load(std::memory_order::relaxed)) {
+      // Stay clear of full, where packets would be dropped.
+      if (spsc.GetCurrentDepth() > max_time / 2) {
+        continue;
+      }
+      const auto packet = Packet{
+              .sequence_number = sequence_number++,
+              .data = payload.data(),
+              .length = payload.size(),
+              .elements = frames_per_packet};
+      spsc.Enqueue(&packet, 1, [](std::span<Packet>) {});
+    }
+  });
+
+  std::vector<std::uint8_t> destination(frame_size * frames_per_packet);
+  std::size_t dequeued = 0;
+  for (auto _: state) {
+    dequeued += spsc.Dequeue(destination.data(), destination.size(), frames_per_packet);
+  }
+  running = false;
+  writer.join();
+  state.SetItemsProcessed(static_cast<std::int64_t>(dequeued));
+}
+BENCHMARK(libjitter_spsc)->UseRealTime();
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Packet.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// @brief How a Concealer fills in missing packets.
+enum class ConcealmentStrategy : std::uint8_t {
+  /// @brief Zeros.
+  Silence,
+  /// @brief The last real packet, fading out.
+  Repeat,
+  /// @brief White noise at the level of the quietest recent packets.
+  ComfortNoise,
+  /// @brief The last pitch period of real audio, repeated and fading out.
+  PitchRepetition,
+};
+
+/**
+ * @brief Built in concealment of interleaved PCM, usable as a span JitterBuffer concealment callback, which writes
+ * straight into the slots the buffer hands out.
+ *
+ * Strategies other than silence work from recent real audio, so every packet enqueued must also be passed to
+ * Observe, in order, on the writer thread. Consecutive losses carry on where the last concealment left off, so fades
+ * span the whole gap rather than restarting each packet.
+ *
+ * @tparam Sample The sample type, std::int16_t or float.
+ */
+template<typename Sample>
+class Concealer {
+  public:
+  /// @brief Default time repeated audio takes to fade to silence.
+  constexpr static std::chrono::milliseconds DEFAULT_FADE = std::chrono::milliseconds(80);
+
+  /**
+   * @brief Construct a new Concealer.
+   *
+   * @param strategy How to fill in missing packets.
+   * @param channels Number of interleaved channels in each element.
+   * @param clock_rate Clock rate of elements in Hz.
+   * @param fade Time repeated audio takes to fade to silence.
+   */
+  Concealer(ConcealmentStrategy strategy, std::size_t channels, std::uint32_t clock_rate, std::chrono::milliseconds fade = DEFAULT_FADE);
+
+  /**
+   * @brief Remember a real packet, as concealment source material.
+   *
+   * @param packet The packet, as passed to Enqueue.
+   */
+  void Observe(const Packet &packet);
+
+  /**
+   * @brief Fill in missing packets.
+   *
+   * @param packets Packets to fill, as handed out by the jitter buffer.
+   */
+  void operator()(std::span<Packet> packets);
+
+  private:
+  /// @brief Independent noise generators, run in lockstep.
+  constexpr static std::size_t NOISE_LANES = 8;
+  /// @brief How quickly the noise floor rises towards louder packets, per packet.
+  constexpr static float NOISE_FLOOR_RISE = 0.05F;
+  /// @brief Pitch periods are searched between these frequencies.
+  const static std::uint32_t MIN_PITCH_HZ = 50;
+  const static std::uint32_t MAX_PITCH_HZ = 400;
+  /// @brief Candidate periods are searched at this stride, then refined.
+  const static std::size_t SEARCH_STEP = 4;
+  /// @brief Lowest normalized correlation considered periodic. Anything less repeats the whole last packet instead.
+  constexpr static double MIN_CORRELATION = 0.5;
+
+  ConcealmentStrategy strategy;
+  std::size_t channels;
+  std::size_t min_period;
+  std::size_t max_period;
+  float fade_step;
+
+  // Most recent real audio, in a ring of ring_capacity samples. Each sample is written twice, ring_capacity apart, so
+  // the newest samples are always contiguous.
+  std::vector<Sample> history;
+  std::size_t history_capacity;
+  std::size_t ring_capacity;
+  std::size_t history_end;
+  std::size_t history_size;
+  std::size_t last_packet_samples;
+
+  // State carried across a run of concealed packets.
+  bool concealing;
+  std::size_t segment_samples;
+  std::size_t segment_offset;
+  float gain;
+
+  float noise_floor;
+  std::array<std::uint32_t, NOISE_LANES> noise_state;
+
+  void Check(const Packet &packet) const;
+  void Remember(const Sample *samples, std::size_t count);
+  const Sample *Newest(std::size_t samples) const;
+  void Begin();
+  void Repeat(Sample *destination, std::size_t samples);
+  void Noise(Sample *destination, std::size_t samples);
+  std::size_t FindPeriod() const;
+  float Rms(const Sample *samples, std::size_t count) const;
+};
+
+extern template class Concealer<std::int16_t>;
+extern template class Concealer<float>;
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Packet.h"
+
+#include <cantina/logger.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Threads that synthesize concealment off the writer's thread, so slow concealment such as model based PLC
+ * never holds up a network receive loop. One set of workers may be shared by many buffers.
+ *
+ * Each buffer is assigned a single worker, so its concealment runs in order, one packet at a time, just as it would
+ * have inline. Buffers are spread across workers round robin.
+ */
+class ConcealmentWorkers {
+  public:
+  /// @brief Fills in concealment packets.
+  typedef std::function<void(std::span<Packet> packets)> Callback;
+
+  /**
+   * @brief A packet to conceal, and how to report it done.
+   *
+   * It's synthesized into the worker's own scratch space, so the slot stays free for real data arriving meanwhile,
+   * and only copied in if the slot still wants it.
+   */
+  struct Job {
+    /// @brief The slot to fill.
+    Packet packet;
+    /// @brief Fills it. Must outlive the job.
+    const Callback *callback;
+    /// @brief State flags of the slot, released once filled.
+    std::atomic<std::uint16_t> *state;
+    /// @brief Flag set in state while the slot still wants concealment. Cleared once real data has replaced it.
+    std::uint16_t wanted_flag;
+    /// @brief Flag that excludes anyone else from the slot's elements. Held in state while copying in.
+    std::uint16_t claim_flag;
+    /// @brief Flags cleared from state once done, whether copied in or not.
+    std::uint16_t done_flags;
+  };
+
+  /**
+   * @brief Construct a new Concealment Workers and start them.
+   *
+   * @param workers Number of worker threads. Zero uses one per hardware thread.
+   * @param logger Pointer to external parent logger.
+   */
+  ConcealmentWorkers(std::size_t workers, const cantina::LoggerPointer &logger);
+
+  /**
+   * @brief Finish every job already submitted, then stop the workers.
+   */
+  ~ConcealmentWorkers();
+
+  ConcealmentWorkers(const ConcealmentWorkers &) = delete;
+  ConcealmentWorkers &operator=(const ConcealmentWorkers &) = delete;
+
+  /**
+   * @returns The worker a new buffer should submit all of its jobs to.
+   */
+  std::size_t Assign();
+
+  /**
+   * @brief Queue jobs on a worker. This may be called from any thread, and only waits for the queue's lock.
+   *
+   * @param worker The worker, from Assign.
+   * @param jobs The jobs, copied into the queue.
+   */
+  void Submit(std::size_t worker, std::span<const ConcealmentWorkers::Job> jobs);
+
+  /**
+   * @brief Wait until every job submitted to a worker so far has finished. Later submissions aren't waited for.
+   *
+   * @param worker The worker, from Assign.
+   */
+  void Drain(std::size_t worker);
+
+  /**
+   * @brief Drain every worker.
+   */
+  void Drain();
+
+  private:
+  struct Worker {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<Job> queue;
+    // Only touched by the worker's own thread.
+    std::vector<std::uint8_t> scratch;
+    // Jobs ever submitted and finished, so a drain only waits for what came before it.
+    std::size_t submitted = 0;
+    std::size_t finished = 0;
+    bool stop = false;
+  };
+
+  cantina::LoggerPointer logger;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<std::size_t> next_worker;
+
+  void Work(Worker &worker);
+  static void Fill(const Job &job, const std::vector<std::uint8_t> &scratch);
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief Counters owned by a single thread, which any other thread can read as a consistent snapshot.
+ *
+ * The owner counts into a private copy with plain arithmetic, and publishes it under a sequence lock once an
+ * operation is complete. Publishing is only relaxed stores, with no read-modify-write, and readers retry rather than
+ * block, so snapshots never hold up the owner. Each block sits on its own cache lines, so one thread's counters never
+ * share a line with another's.
+ *
+ * @tparam Count Number of counters.
+ */
+template<std::size_t Count>
+class alignas(64) CounterBlock {
+  public:
+  /**
+   * @brief Add to a counter. Only the owning thread may call this.
+   *
+   * @param counter Index of the counter.
+   * @param value Amount to add.
+   */
+  void Add(const std::size_t counter, const unsigned long value) {
+    pending[counter] += value;
+    dirty = true;
+  }
+
+  /**
+   * @brief Make counts added so far visible to snapshots. Only the owning thread may call this.
+   */
+  void Publish() {
+    if (!dirty) {
+      return;
+    }
+    const unsigned long sequence = this->sequence.load(std::memory_order::relaxed);
+    this->sequence.store(sequence + 1, std::memory_order::relaxed);
+    std::atomic_thread_fence(std::memory_order::release);
+    for (std::size_t counter = 0; counter < Count; counter++) {
+      published[counter].store(pending[counter], std::memory_order::relaxed);
+    }
+    this->sequence.store(sequence + 2, std::memory_order::release);
+    dirty = false;
+  }
+
+  /**
+   * @brief Read the counters as of the last Publish. This may be called from any thread.
+   *
+   * @returns The counters.
+   */
+  std::array<unsigned long, Count> Snapshot() const {
+    std::array<unsigned long, Count> snapshot;
+    unsigned long before;
+    unsigned long after;
+    do {
+      before = sequence.load(std::memory_order::acquire);
+      for (std::size_t counter = 0; counter < Count; counter++) {
+        snapshot[counter] = published[counter].load(std::memory_order::relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order::acquire);
+      after = sequence.load(std::memory_order::relaxed);
+    } while (before != after || (before & 1) != 0);
+    return snapshot;
+  }
+
+  private:
+  std::array<unsigned long, Count> pending{};
+  bool dirty = false;
+  std::atomic<unsigned long> sequence{0};
+  std::array<std::atomic<unsigned long>, Count> published{};
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+/**
+ * @brief Estimates how much faster elements arrive than they are consumed, i.e. the drift between the sender's clock
+ * and the playout device's.
+ *
+ * Each running total is fitted against the time it was taken at with exponentially weighted least squares, so packet
+ * jitter and bursty reads average out, and the drift is the ratio of the two slopes less one. Arrivals are fitted
+ * against their own times rather than when they were observed, so packet sized steps don't alias against reads.
+ * Coordinates are re-centred on every sample, so precision doesn't decay over long calls.
+ */
+class DriftEstimator {
+  public:
+  /**
+   * @brief Construct a new Drift Estimator.
+   *
+   * @param time_constant How long samples take to fade to about a third of their weight.
+   */
+  explicit DriftEstimator(std::chrono::seconds time_constant);
+
+  /**
+   * @brief Record the arrival total as of when the last element arrived. A sample whose time hasn't moved is ignored.
+   *
+   * @param total Elements that have ever arrived.
+   * @param at When the last of those arrived.
+   */
+  void Arrived(std::uint64_t total, std::chrono::nanoseconds at);
+
+  /**
+   * @brief Record the consumption total as of now. A sample whose time hasn't moved is ignored.
+   *
+   * @param total Elements that have ever been consumed.
+   * @param now The current time.
+   */
+  void Consumed(std::uint64_t total, std::chrono::nanoseconds now);
+
+  /**
+   * @brief Mark a gap in both totals, such as the sender going quiet and starving the reader. The next sample of each
+   * carries on from its last, so neither jump across the gap is mistaken for a rate.
+   */
+  void Interrupted();
+
+  /**
+   * @return Arrival rate over consumption rate, less one, or nothing until a time constant has been observed.
+   */
+  std::optional<double> GetDrift() const;
+
+  private:
+  /// @brief Weighted least squares fit of one running total against time.
+  struct Fit {
+    std::optional<std::chrono::nanoseconds> first_time;
+    std::chrono::nanoseconds last_time{0};
+    std::uint64_t last_total = 0;
+    bool interrupted = false;
+
+    // Decayed sums of weight, time, time squared, total and total times time, relative to the last sample.
+    double weight = 0;
+    double time = 0;
+    double time_squared = 0;
+    double total = 0;
+    double total_time = 0;
+
+    void Add(std::uint64_t total, std::chrono::nanoseconds now, double time_constant);
+    std::optional<double> GetSlope(double time_constant) const;
+  };
+
+  double time_constant;
+  Fit arrived;
+  Fit consumed;
+};
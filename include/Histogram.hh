@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * @brief Constant memory histogram with logarithmic buckets, each power of two split into SUB_BUCKETS, so any value
+ * is placed within 25% of itself.
+ *
+ * Values are recorded by a single owning thread, with a relaxed load and store rather than a read-modify-write.
+ * Queries may come from any thread. They see each bucket exactly, though not necessarily every bucket as of the same
+ * instant, which is good enough for percentiles.
+ */
+class alignas(64) Histogram {
+  public:
+  constexpr static std::size_t SUB_BUCKET_BITS = 2;
+  constexpr static std::size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  /// @brief Enough buckets for any 64 bit value.
+  constexpr static std::size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  /**
+   * @brief Record a value. Only the owning thread may call this.
+   *
+   * @param value The value.
+   */
+  void Record(const std::uint64_t value) {
+    std::atomic<std::uint64_t> &count = counts[Bucket(value)];
+    count.store(count.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+  }
+
+  /**
+   * @returns Number of values recorded.
+   */
+  std::uint64_t GetCount() const {
+    std::uint64_t total = 0;
+    for (const auto &count: counts) {
+      total += count.load(std::memory_order::relaxed);
+    }
+    return total;
+  }
+
+  /**
+   * @brief Find the value the given fraction of recorded values are at or below.
+   *
+   * @param quantile Fraction between 0 and 1, e.g 0.99 for the 99th percentile.
+   * @returns Upper bound of the bucket holding that value, or 0 if nothing has been recorded.
+   */
+  std::uint64_t Percentile(const double quantile) const {
+    if (!(quantile >= 0 && quantile <= 1)) {
+      std::ostringstream message;
+      message << "Quantile must be between 0 and 1. Got: " << quantile;
+      throw std::invalid_argument(message.str());
+    }
+
+    std::array<std::uint64_t, BUCKETS> snapshot;
+    std::uint64_t total = 0;
+    for (std::size_t bucket = 0; bucket < BUCKETS; bucket++) {
+      snapshot[bucket] = counts[bucket].load(std::memory_order::relaxed);
+      total += snapshot[bucket];
+    }
+    if (total == 0) {
+      return 0;
+    }
+
+    const auto rank = std::max<std::uint64_t>(static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(total))), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < BUCKETS; bucket++) {
+      seen += snapshot[bucket];
+      if (seen >= rank) {
+        return UpperBound(bucket);
+      }
+    }
+    return UpperBound(BUCKETS - 1);
+  }
+
+  /**
+   * @param value A value.
+   * @returns Index of the bucket holding it.
+   */
+  static constexpr std::size_t Bucket(const std::uint64_t value) {
+    if (value < SUB_BUCKETS) {
+      return value;
+    }
+    const std::size_t exponent = std::bit_width(value) - 1;
+    const std::size_t sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return ((exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS) + sub_bucket;
+  }
+
+  /**
+   * @param bucket Index of a bucket.
+   * @returns The largest value it holds.
+   */
+  static constexpr std::uint64_t UpperBound(const std::size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+      return bucket;
+    }
+    const std::size_t shift = (bucket / SUB_BUCKETS) - 1;
+    const std::uint64_t lower = static_cast<std::uint64_t>(SUB_BUCKETS + (bucket % SUB_BUCKETS)) << shift;
+    return lower + ((std::uint64_t{1} << shift) - 1);
+  }
+
+  private:
+  std::array<std::atomic<std::uint64_t>, BUCKETS> counts{};
+};
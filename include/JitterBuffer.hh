@@ -2,52 +2,198 @@
 
 #include "Packet.h"
 #include "Metrics.h"
+#include "ConcealmentWorkers.hh"
+#include "CounterBlock.hh"
+#include "DriftEstimator.hh"
+#include "Histogram.hh"
+#include "JitterEstimator.hh"
+#include "RingArena.hh"
+#include "SampleFormat.hh"
 
 #include <cantina/logger.h>
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <cassert>
 #include <chrono>
+#include <cmath>
+#include <concepts>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
-struct Header {
+/// @brief Metadata describing a packet held in the buffer. Headers live in their own table, apart from the elements.
+struct alignas(16) Header {
+  /// @brief State flag: this packet holds concealment data.
+  static constexpr std::uint16_t CONCEALMENT = 1 << 0;
+  /// @brief State flag: this packet is being read or updated, or its concealment copied in by a worker.
+  static constexpr std::uint16_t IN_USE = 1 << 1;
+  /// @brief State flag: this concealment packet's slot is reserved, but its elements haven't been synthesized yet.
+  static constexpr std::uint16_t PLACEHOLDER = 1 << 2;
+  /// @brief State flag: this concealment packet is being synthesized on a worker. Readers skip it, but an update may
+  /// still replace it, and the worker then leaves it be.
+  static constexpr std::uint16_t PENDING = 1 << 3;
+
+  /// @brief When this packet was written, in nanoseconds on the buffer's clock.
+  std::int64_t timestamp;
   std::uint32_t sequence_number;
+  /// @brief Elements left to read. Partial reads shrink this.
+  std::uint16_t elements;
+  std::atomic<std::uint16_t> state;
+};
+
+/// @brief A read-only view of contiguous elements held in the buffer.
+struct ReadView {
+  /// @brief Pointer to the first element. Valid until the view is committed.
+  const std::uint8_t *data;
+  /// @brief Number of elements available at data.
   std::size_t elements;
-  std::uint64_t timestamp;
+  /// @brief Sequence number of the packet these elements belong to.
+  std::uint32_t sequence_number;
+  /// @brief True if these elements were generated by concealment.
   bool concealment;
-  std::atomic_flag in_use = ATOMIC_FLAG_INIT;
-  std::size_t previous_elements;
 };
 
-class JitterBuffer {
+/// @brief Distributions of a buffer's behaviour, all in microseconds.
+struct Histograms {
+  /// @brief How much each packet's arrival gap differed from its media time gap to the previous arrival.
+  Histogram arrival_jitter;
+  /// @brief How long each packet was held between being written and first being read.
+  Histogram residence;
+  /// @brief Depth of the buffer at each dequeue.
+  Histogram depth;
+};
+
+/// @brief Mirrored virtual memory backing the ring, so reads and writes never need to wrap mid copy.
+struct VirtualMemory {
+  /**
+   * @brief Map length bytes twice, back to back.
+   * @param length Wanted length in bytes, rounded up to a whole number of pages.
+   * @param user_data Platform specific storage for the mapping.
+   * @return Address of the first mapping.
+   */
+  [[nodiscard]] static void *Make(std::size_t &length, void *user_data);
+  static void Free(void *address, std::size_t length, void *user_data);
+};
+
+/// @brief A file descriptor another thread can make readable, for poll, select or epoll: an eventfd, or a pipe where
+/// there are none.
+class NotificationFd {
+  public:
+  NotificationFd();
+  ~NotificationFd();
+  NotificationFd(const NotificationFd &) = delete;
+  NotificationFd &operator=(const NotificationFd &) = delete;
+
+  /// @returns The descriptor to wait on.
+  int Get() const;
+  /// @brief Make the descriptor readable. This may be called from any thread.
+  void Signal();
+  /// @brief Make the descriptor unreadable again.
+  void Clear();
+
+  private:
+  int read_fd;
+  int write_fd;
+};
+
+/**
+ * @brief A jitter buffer whose element size, packet elements and ring capacity may be fixed at compile time.
+ * Fixed sizes fold hot path multiplies into constants, and a power of two capacity makes wrapping a mask.
+ * Any left as std::dynamic_extent are taken from the constructor instead.
+ *
+ * @tparam ElementSizeBytes Size of held elements in bytes.
+ * @tparam PacketElementCount Number of elements in packets.
+ * @tparam CapacityBytes Size of the ring in bytes. This must be a whole number of pages, and replaces the size
+ * otherwise derived from max_length.
+ */
+template<std::size_t ElementSizeBytes = std::dynamic_extent, std::size_t PacketElementCount = std::dynamic_extent, std::size_t CapacityBytes = std::dynamic_extent>
+class BasicJitterBuffer {
   public:
   const static std::size_t METADATA_SIZE = sizeof(Header);
+  const static std::size_t NO_POSITION = SIZE_MAX;
+  const static std::size_t CACHE_LINE_SIZE = 64;
+  /// @brief Default averaging time of the drift estimate.
+  constexpr static std::chrono::seconds DEFAULT_DRIFT_TIME_CONSTANT = std::chrono::seconds(30);
 
   typedef std::function<void(std::vector<Packet> &packets)> ConcealmentCallback;
 
+  /// @brief A concealment callback taking a span over the buffer's own packet array, so concealment doesn't allocate.
+  template<typename Callback>
+  static constexpr bool IsSpanConcealment = std::invocable<Callback &, std::span<Packet>>;
+
+  /// @brief A concealment callback the buffer keeps, to run later off the writer thread.
+  typedef ConcealmentWorkers::Callback DeferredConcealmentCallback;
+
+  /// @brief Source of the current time, as a monotonic duration since a fixed epoch.
+  typedef std::function<std::chrono::nanoseconds()> Clock;
+
+  /**
+   * @brief Writes exactly destination_elements to destination from the start of source, to speed up or slow down playout.
+   * When source_elements is greater than destination_elements, consume more than is produced to speed up.
+   * Otherwise, consume fewer to slow down. Consuming exactly destination_elements leaves the rate unchanged.
+   * @returns The number of source elements consumed.
+   */
+  typedef std::function<std::size_t(const std::uint8_t *source, std::size_t source_elements, std::uint8_t *destination, std::size_t destination_elements)> TimeStretchCallback;
+
   /**
    * @brief Construct a new Jitter Buffer object.
    *
    * @param element_size Size of held elements in bytes.
-   * @param packet_elements Number of elements in packets.
+   * @param packet_elements Nominal number of elements in packets. Packets may vary, and concealment follows the
+   * most recent packet, but this is assumed until the first arrives.
+   * @param clock_rate Clock rate of elements contained in Hz. E.g 48kHz audio is 48000.
+   * @param max_length The maximum lenghth of the buffer in milliseconds.
+   * @param min_length The minimum age of packets in milliseconds before eligible for dequeue.
+   * @param clock Source of the current time. Defaults to std::chrono::steady_clock.
+   * @param arena Arena to take the ring from, and return it to on destruction. Defaults to a dedicated mapping.
+   */
+  BasicJitterBuffer(std::size_t element_size,
+                    std::size_t packet_elements,
+                    std::uint32_t clock_rate,
+                    std::chrono::milliseconds max_length,
+                    std::chrono::milliseconds min_length,
+                    const cantina::LoggerPointer &logger,
+                    const Clock &clock = nullptr,
+                    const std::shared_ptr<RingArena> &arena = nullptr);
+
+  /**
+   * @brief Construct a new Jitter Buffer object, with element size and packet elements fixed at compile time.
+   *
    * @param clock_rate Clock rate of elements contained in Hz. E.g 48kHz audio is 48000.
    * @param max_length The maximum lenghth of the buffer in milliseconds.
    * @param min_length The minimum age of packets in milliseconds before eligible for dequeue.
+   * @param clock Source of the current time. Defaults to std::chrono::steady_clock.
+   * @param arena Arena to take the ring from, and return it to on destruction. Defaults to a dedicated mapping.
    */
-  JitterBuffer(std::size_t element_size,
-               std::size_t packet_elements,
-               std::uint32_t clock_rate,
-               std::chrono::milliseconds max_length,
-               std::chrono::milliseconds min_length,
-               const cantina::LoggerPointer &logger);
+  BasicJitterBuffer(const std::uint32_t clock_rate,
+                    const std::chrono::milliseconds max_length,
+                    const std::chrono::milliseconds min_length,
+                    const cantina::LoggerPointer &logger,
+                    const Clock &clock = nullptr,
+                    const std::shared_ptr<RingArena> &arena = nullptr)
+    requires(ElementSizeBytes != std::dynamic_extent && PacketElementCount != std::dynamic_extent)
+      : BasicJitterBuffer(ElementSizeBytes, PacketElementCount, clock_rate, max_length, min_length, logger, clock, arena) {}
 
   /**
    * @brief Destroy the Jitter Buffer object
    */
-  ~JitterBuffer();
+  ~BasicJitterBuffer();
 
   /**
    * @brief Prepare the buffer for the given sequence number, generating concealment data for any missing packets.
@@ -58,7 +204,21 @@ class JitterBuffer {
   std::size_t Prepare(const std::uint32_t sequence_number, const ConcealmentCallback &concealment_callback);
 
   /**
-   * @brief Enqueue a number of packets onto the buffer. This must be called from a single writer thread.
+   * @brief Prepare, with a callback that is given a span of concealment packets instead of a vector.
+   * Neither the callback nor the packets are allocated.
+   *
+   * @param sequence_number The sequence number to prepare for.
+   * @param concealment_callback Fired when concealment data needs to be generated. The span is only valid for the call.
+   */
+  template<typename Callback>
+    requires IsSpanConcealment<Callback>
+  std::size_t Prepare(const std::uint32_t sequence_number, Callback &&concealment_callback) {
+    return DoPrepare(sequence_number, ConcealmentRef(concealment_callback));
+  }
+
+  /**
+   * @brief Enqueue a number of packets onto the buffer. This must be called from a single writer thread, unless
+   * multiple producers are enabled.
    *
    * @param packets The packets to enqueue.
    * @param concealment_callback Fired when concealment data needs to be generated.
@@ -66,6 +226,79 @@ class JitterBuffer {
    */
   std::size_t Enqueue(const std::vector<Packet> &packets, const ConcealmentCallback &concealment_callback);
 
+  /**
+   * @brief Enqueue a number of packets onto the buffer, straight from an array. This must be called from a single
+   * writer thread, unless multiple producers are enabled.
+   *
+   * @param packets The packets to enqueue.
+   * @param count The number of packets.
+   * @param concealment_callback Fired when concealment data needs to be generated.
+   * @returns The number of elements actually enqueued, including concealment.
+   */
+  std::size_t Enqueue(const Packet *packets, std::size_t count, const ConcealmentCallback &concealment_callback);
+
+  /**
+   * @brief Enqueue, with a callback that is given a span of concealment packets instead of a vector.
+   * Neither the callback nor the packets are allocated.
+   *
+   * @param packets The packets to enqueue.
+   * @param count The number of packets.
+   * @param concealment_callback Fired when concealment data needs to be generated. The span is only valid for the call.
+   * @returns The number of elements actually enqueued, including concealment.
+   */
+  template<typename Callback>
+    requires IsSpanConcealment<Callback>
+  std::size_t Enqueue(const Packet *packets, const std::size_t count, Callback &&concealment_callback) {
+    return DoEnqueue(packets, count, ConcealmentRef(concealment_callback));
+  }
+
+  /**
+   * @brief Enqueue from a vector, with a callback that is given a span of concealment packets instead of a vector.
+   *
+   * @param packets The packets to enqueue.
+   * @param concealment_callback Fired when concealment data needs to be generated. The span is only valid for the call.
+   * @returns The number of elements actually enqueued, including concealment.
+   */
+  template<typename Callback>
+    requires IsSpanConcealment<Callback>
+  std::size_t Enqueue(const std::vector<Packet> &packets, Callback &&concealment_callback) {
+    return DoEnqueue(packets.data(), packets.size(), ConcealmentRef(concealment_callback));
+  }
+
+  /**
+   * @brief Reserve space in the buffer for the next packet so it can be written in place, avoiding a copy.
+   * Room is left in front of it for any missing packets, which are concealed on commit.
+   * The packet is not visible to the reader until CommitWrite, and no other writes may happen in between.
+   * This must be called from the single writer thread. With multiple producers, other producers wait from a
+   * successful reservation until its CommitWrite, which must come from the same thread.
+   *
+   * @param sequence_number The sequence number of the packet to be written.
+   * @param elements The number of elements to be written.
+   * @returns Pointer to write the packet's elements to, or nullptr if it is not newer than the last written
+   * packet (use Enqueue for updates) or there is no space.
+   */
+  std::uint8_t *ReserveWrite(std::uint32_t sequence_number, std::size_t elements);
+
+  /**
+   * @brief Publish the packet written to the slot returned by ReserveWrite.
+   *
+   * @param concealment_callback Fired when concealment data needs to be generated.
+   * @returns The number of elements actually enqueued, including concealment.
+   */
+  std::size_t CommitWrite(const ConcealmentCallback &concealment_callback);
+
+  /**
+   * @brief CommitWrite, with a callback that is given a span of concealment packets instead of a vector.
+   *
+   * @param concealment_callback Fired when concealment data needs to be generated. The span is only valid for the call.
+   * @returns The number of elements actually enqueued, including concealment.
+   */
+  template<typename Callback>
+    requires IsSpanConcealment<Callback>
+  std::size_t CommitWrite(Callback &&concealment_callback) {
+    return DoCommitWrite(ConcealmentRef(concealment_callback));
+  }
+
   /**
    * @brief Dequeue a number of packets into the given destination. This must be called from a single reader thread.
    *
@@ -76,9 +309,100 @@ class JitterBuffer {
    */
   std::size_t Dequeue(std::uint8_t *destination, const std::size_t &destination_length, const std::size_t &elements);
 
+  /**
+   * @brief Dequeue a number of packets into the given destination, as of the given time.
+   * Use this to pass in a time already taken, such as an audio callback's, to save reading the clock.
+   *
+   * @param destination The buffer to copy the data into.
+   * @param destination_length Length of destination buffer in bytes.
+   * @param elements The number of elements to dequeue.
+   * @param now The current time on the buffer's clock.
+   * @returns The number of elements actually dequeued.
+   */
+  std::size_t Dequeue(std::uint8_t *destination, const std::size_t &destination_length, const std::size_t &elements, std::chrono::nanoseconds now);
+
+  /**
+   * @brief Dequeue, converting sample format and layout while copying out of the buffer, so each sample is only
+   * touched once. This must be called from a single reader thread. With time stretching enabled, stretched audio is
+   * converted in a second pass.
+   *
+   * @param destination The buffer to write converted data into.
+   * @param destination_length Length of destination buffer in bytes.
+   * @param elements The number of elements to dequeue. A planar destination holds this many elements per channel,
+   * even if fewer are dequeued.
+   * @param source_format Format of the enqueued elements. Must be interleaved, and match the element size.
+   * @param destination_format Format to write. Must have as many channels as the source.
+   * @returns The number of elements actually dequeued.
+   */
+  std::size_t Dequeue(std::uint8_t *destination, std::size_t destination_length, std::size_t elements, const SampleFormat &source_format, const SampleFormat &destination_format);
+
+  /**
+   * @brief Converting Dequeue, as of the given time.
+   *
+   * @param destination The buffer to write converted data into.
+   * @param destination_length Length of destination buffer in bytes.
+   * @param elements The number of elements to dequeue.
+   * @param source_format Format of the enqueued elements.
+   * @param destination_format Format to write.
+   * @param now The current time on the buffer's clock.
+   * @returns The number of elements actually dequeued.
+   */
+  std::size_t Dequeue(std::uint8_t *destination, std::size_t destination_length, std::size_t elements, const SampleFormat &source_format, const SampleFormat &destination_format, std::chrono::nanoseconds now);
+
+  /// @brief A buffer to mix from, and how loud.
+  struct MixSource {
+    BasicJitterBuffer *buffer;
+    float gain;
+  };
+
+  /**
+   * @brief Dequeue from several buffers at once, adding each one's playable elements straight into the destination
+   * with its gain, instead of dequeuing each into scratch and summing. Each source is read exactly as Dequeue would,
+   * as of its own clock, and sources with fewer elements simply contribute silence for the rest. This must be called
+   * from the reader thread of every source.
+   *
+   * @param sources The buffers to mix, with per source gains. All must have the same element size.
+   * @param type Type of every sample. Int16 sums saturate, float sums don't clip.
+   * @param destination The buffer to mix into. It is overwritten, not added to.
+   * @param destination_length Length of destination buffer in bytes.
+   * @param elements The number of elements to mix.
+   * @returns The most elements any source contributed.
+   */
+  static std::size_t DequeueMix(std::span<const MixSource> sources, SampleType type, std::uint8_t *destination, std::size_t destination_length, std::size_t elements);
+
+  /**
+   * @brief Get a view of the next available elements in place, without copying them out of the buffer.
+   * Expired packets are skipped as in Dequeue. A view never spans packets, so it may hold fewer elements than
+   * requested. Repeated calls without a commit return the same packet. This must be called from a single reader thread.
+   *
+   * @param elements The maximum number of elements wanted.
+   * @returns A view of the next elements, or nothing if no data is available.
+   */
+  std::optional<ReadView> PeekRead(std::size_t elements);
+
+  /**
+   * @brief PeekRead, as of the given time.
+   *
+   * @param elements The maximum number of elements wanted.
+   * @param now The current time on the buffer's clock.
+   * @returns A view of the next elements, or nothing if no data is available.
+   */
+  std::optional<ReadView> PeekRead(std::size_t elements, std::chrono::nanoseconds now);
+
+  /**
+   * @brief Consume elements from the view returned by the last PeekRead, invalidating it.
+   * Committing fewer elements than were viewed leaves the remainder of the packet for the next read. Committing
+   * elements without holding a view throws.
+   *
+   * @param elements The number of elements consumed. Zero releases the view without consuming anything, and does
+   * nothing if no view is held.
+   */
+  void CommitRead(std::size_t elements);
+
   /**
    * @brief Get a read pointer for the buffer at the given packet offset.
-   * @param read_offset_elements Offset in packets.
+   * Packets can be of any size, so this walks the held packets. Only use it for inspection.
+   * @param read_offset_elements Offset in packets, counted from the first packet written. It must still be held.
    * @return Pointer into the buffer at the requested offset.
    */
   std::uint8_t *GetReadPointerAtPacketOffset(std::size_t read_offset_elements) const;
@@ -89,8 +413,176 @@ class JitterBuffer {
    */
   std::chrono::milliseconds GetCurrentDepth() const;
 
+  /**
+   * @brief Adapt the target depth to measured network jitter, instead of using a fixed min_length.
+   * The target moves within [floor, max_length] to cover the given quantile of packet delays.
+   * This must be called from the writer thread.
+   *
+   * @param floor The lowest the target depth may go.
+   * @param quantile The proportion of packets that should arrive in time to be played.
+   */
+  void EnableAdaptiveDepth(std::chrono::milliseconds floor, float quantile = 0.95f);
+
+  /**
+   * @brief Allow Prepare, Enqueue, ReserveWrite and CommitWrite to be called from any number of threads at once,
+   * such as several network receive threads. Producers take turns, and concealment callbacks run on whichever
+   * producer needed them, still one at a time. Reading is unaffected, and stays lock free.
+   * This must be called before any producer starts.
+   */
+  void EnableMultipleProducers();
+
+  /**
+   * @brief Allow the reader to sleep until data arrives, with WaitForElements or GetNotificationFd, rather than poll
+   * Dequeue. Writers then check for a sleeping reader after each write, and wake it if there is one.
+   * This must be called before the writer starts.
+   */
+  void EnableNotifications();
+
+  /**
+   * @brief Wait until at least the given number of elements are held and the buffer is playing, or the timeout
+   * passes. For readers not driven by an audio device. Notifications must be enabled, and this must be called from
+   * the reader thread.
+   *
+   * @param elements The number of elements wanted.
+   * @param timeout The longest to wait, in real time.
+   * @returns True if the elements are available.
+   */
+  bool WaitForElements(std::size_t elements, std::chrono::nanoseconds timeout);
+
+  /**
+   * @brief Get a file descriptor that becomes readable when data is written, to sleep on in an existing event loop.
+   * When it wakes, call AcknowledgeNotification, then dequeue until there's nothing left, so that nothing written in
+   * between is missed. Notifications must be enabled. The descriptor belongs to the buffer.
+   *
+   * @returns The file descriptor.
+   */
+  int GetNotificationFd();
+
+  /**
+   * @brief Make the notification descriptor unreadable, and arm it for the next write. This must be called from the
+   * reader thread.
+   */
+  void AcknowledgeNotification();
+
+  /**
+   *
+   * @return Depth the buffer fills to before playing, and tops up to with concealment. This is min_length,
+   * unless adaptive depth is enabled.
+   */
+  std::chrono::milliseconds GetTargetDepth() const;
+
+  /**
+   * @brief Steer depth toward the target by time stretching in Dequeue, rather than waiting for packets to expire
+   * or concealment to fill. Dequeue accelerates when more than a packet above target, and decelerates when more
+   * than a packet below it. This must be called from the reader thread, before dequeuing.
+   *
+   * @param callback Stretches dequeued elements, such as a Wsola instance.
+   * @param lookahead The most elements beyond those produced the callback may consume in one call.
+   */
+  void EnableTimeStretch(const TimeStretchCallback &callback, std::size_t lookahead);
+
+  /**
+   * @brief Defer concealment until it's needed. Gaps are recorded as placeholder slots, and the given callback only
+   * fills one in when a read reaches it still missing, so concealment of packets that turn up late is never thrown
+   * away. Late packets are copied straight into their placeholder. The callbacks passed to Prepare, Enqueue and
+   * CommitWrite are then never fired, and metrics count concealment when the gap is recorded, as before.
+   * This must be called before the writer starts.
+   *
+   * @param callback Fills in placeholders. It runs on the reader thread, one packet at a time, in order, so it must
+   * not share unsynchronized state with the writer.
+   */
+  void EnableLazyConcealment(const DeferredConcealmentCallback &callback);
+
+  /**
+   * @brief Synthesize concealment on a worker thread, so the writer never waits on it. Gaps are reserved and handed to
+   * the workers, and a read that reaches one still being synthesized skips it, as it would a packet being updated.
+   * Late packets still update a slot while it's being synthesized, and take precedence. The callbacks passed to Prepare, Enqueue and CommitWrite
+   * are then never fired, and metrics count concealment when the gap is reserved, as before. Space isn't reused until
+   * its concealment finishes, and destruction waits for any outstanding. This must be called before the writer starts,
+   * and can't be combined with lazy concealment.
+   *
+   * @param callback Fills in missing packets. It runs on this buffer's worker, one packet at a time, in order, so it
+   * must not share unsynchronized state with the writer.
+   * @param workers Workers to run concealment on, which may be shared with other buffers.
+   */
+  void EnableAsyncConcealment(const DeferredConcealmentCallback &callback, const std::shared_ptr<ConcealmentWorkers> &workers);
+
+  /**
+   * @brief Compensate for drift between the sender's clock and the playout device's by resampling in Dequeue.
+   * The rate elements arrive at is compared with the rate they're asked for, and Dequeue consumes faster or slower
+   * to match, plus a slow correction toward the target depth. Changes are continuous, so there are no periodic
+   * glitches. Time stretching, if enabled, still handles larger excursions. This must be called from the reader
+   * thread, before dequeuing.
+   *
+   * @param format Format of the enqueued elements. Must be interleaved, and match the element size.
+   * @param time_constant How long the drift estimate averages over.
+   */
+  void EnableDriftCompensation(const SampleFormat &format, std::chrono::seconds time_constant = DEFAULT_DRIFT_TIME_CONSTANT);
+
+  /**
+   * @return Estimated drift of the sender's clock relative to the playout device's, in parts per million. Positive
+   * when the sender runs fast. Zero until drift compensation has gathered enough history.
+   */
+  double GetClockDrift() const;
+
+  /**
+   * @brief Snapshot the metrics. This may be called from any thread, and never holds up the reader or writer.
+   * Counters reflect writes and reads that have returned.
+   *
+   * @returns The metrics.
+   */
   Metrics GetMetrics() const;
 
+  /**
+   * @brief Distributions of arrival jitter, residence time and depth, for tuning min_length and max_length.
+   * These may be queried from any thread.
+   *
+   * @returns The buffer's histograms.
+   */
+  const Histograms &GetHistograms() const {
+    return histograms;
+  }
+
+  /**
+   * @return Size of held elements in bytes.
+   */
+  constexpr std::size_t GetElementSize() const {
+    if constexpr (ElementSizeBytes == std::dynamic_extent) {
+      return element_size;
+    } else {
+      return ElementSizeBytes;
+    }
+  }
+
+  /**
+   * @return Number of elements in packets.
+   */
+  constexpr std::size_t GetPacketElements() const {
+    if constexpr (PacketElementCount == std::dynamic_extent) {
+      return packet_elements;
+    } else {
+      return PacketElementCount;
+    }
+  }
+
+  /**
+   * @return Size of the ring in bytes.
+   */
+  constexpr std::size_t GetCapacity() const {
+    if constexpr (CapacityBytes == std::dynamic_extent) {
+      return max_size_bytes;
+    } else {
+      return CapacityBytes;
+    }
+  }
+
+  /**
+   * @return Pages backing the ring. Only an arena asked for huge pages gives anything but standard pages.
+   */
+  RingBacking GetRingBacking() const {
+    return backing;
+  }
+
 #ifdef LIBJITTER_BUILD_TESTS
   friend class BufferInspector;
 #endif
@@ -98,36 +590,1544 @@ class JitterBuffer {
   public:
   cantina::LoggerPointer logger;
 
+  /// @brief The default clock, std::chrono::steady_clock.
+  static std::chrono::nanoseconds SteadyClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
+  }
+
   private:
+  /// @brief Non-owning reference to a concealment callable, so it needn't be copied into a std::function.
+  class ConcealmentRef {
+    public:
+    template<typename Callback>
+    explicit ConcealmentRef(Callback &callback)
+        : callable(const_cast<void *>(static_cast<const void *>(std::addressof(callback)))),
+          invoke([](void *callable, const std::span<Packet> packets) {
+            (*static_cast<Callback *>(callable))(packets);
+          }) {}
+
+    void operator()(const std::span<Packet> packets) const {
+      invoke(callable, packets);
+    }
+
+    private:
+    void *callable;
+    void (*invoke)(void *callable, std::span<Packet> packets);
+  };
+
+  /// @brief Progress of one side of the buffer, published for the other.
+  struct alignas(CACHE_LINE_SIZE) Cursor {
+    std::atomic<std::size_t> bytes{0};
+    std::atomic<std::size_t> packets{0};
+    std::atomic<std::size_t> elements{0};
+    /// @brief Clock reading, in nanoseconds, as of the last publish. Only the writer keeps this.
+    std::atomic<std::int64_t> time{0};
+  };
+
+  /// @brief Where a sequence number was written, so it can be found again in O(1).
+  struct IndexEntry {
+    unsigned long sequence_number;
+    std::size_t packet;
+    std::size_t position;
+    std::size_t elements;
+    bool concealment;
+  };
+
+  Clock clock;
   std::size_t element_size;
   std::size_t packet_elements;
   std::chrono::milliseconds clock_rate;
   std::chrono::milliseconds min_length;
   std::chrono::milliseconds max_length;
+  std::atomic<std::chrono::milliseconds> target_depth;
+  std::optional<JitterEstimator> estimator;
+  std::chrono::milliseconds adaptive_floor;
 
   std::uint8_t *buffer;
-  std::size_t read_offset;
-  std::size_t write_offset;
   std::size_t max_size_bytes;
-  std::atomic<std::size_t> written;
-  std::atomic<std::size_t> written_elements;
+  Header *metadata;
+  std::size_t metadata_capacity;
   std::optional<unsigned long> last_written_sequence_number;
+  std::size_t last_packet_elements;
+  /// @brief last_packet_elements, published for the reader.
+  std::atomic<std::size_t> reader_packet_elements;
+  std::optional<std::uint32_t> newest_arrival;
+  std::int64_t newest_arrival_start;
+  std::int64_t newest_arrival_end;
   std::atomic<bool> play;
   void *vm_user_data;
-  std::size_t latest_written_elements;
-  std::atomic<unsigned long> dont_walk_beyond;
-  std::atomic<unsigned long> skipped_frames;
-  Metrics metrics;
+  std::shared_ptr<RingArena> arena;
+  RingBacking backing;
+  std::vector<IndexEntry> index;
+  std::vector<Packet> concealment_packets;
+  std::size_t peeked_elements;
+  bool peeked_in_use;
+  std::uint32_t reserved_sequence_number;
+  std::size_t reserved_elements;
+  std::size_t reserved_concealment;
+  DeferredConcealmentCallback lazy_concealment;
+
+  /// @brief Where a concealment packet still being synthesized lies, so the writer doesn't reuse it.
+  struct PendingSlot {
+    std::size_t packet;
+    std::size_t position;
+  };
+
+  // Async concealment: jobs are built in concealment_jobs, and remembered in order in pending_slots until finished.
+  DeferredConcealmentCallback async_concealment;
+  std::shared_ptr<ConcealmentWorkers> concealment_workers;
+  std::size_t concealment_worker;
+  std::vector<ConcealmentWorkers::Job> concealment_jobs;
+  std::vector<PendingSlot> pending_slots;
+  std::size_t pending_begin;
+  std::size_t pending_end;
+  TimeStretchCallback time_stretch;
+  std::size_t stretch_lookahead;
+  std::vector<std::uint8_t> stretch_buffer;
+  std::size_t stretch_elements;
+  std::vector<std::uint8_t> convert_buffer;
+
+  /// @brief Weight of each Dequeue's depth in the smoothed depth drift compensation steers by.
+  constexpr static double DEPTH_SMOOTHING = 0.01;
+  /// @brief Drift compensation aims to close the gap to the target depth over this long.
+  constexpr static std::chrono::duration<double> DEPTH_CORRECTION_TIME = std::chrono::seconds(10);
+  /// @brief Most drift compensation will speed up or slow down playout. 0.5% is about 9 cents of pitch.
+  constexpr static double MAX_RATE_CORRECTION = 0.005;
+
+  // Drift compensation: source elements are pulled into resample_buffer, and read at a fractional position.
+  std::optional<DriftEstimator> drift_estimator;
+  SampleFormat drift_format;
+  std::vector<std::uint8_t> resample_buffer;
+  std::size_t resample_elements;
+  double resample_position;
+  std::uint64_t produced_elements;
+  double smoothed_depth;
+  std::atomic<double> clock_drift;
 
-  std::size_t GenerateConcealment(std::size_t packets, const ConcealmentCallback &callback);
+  // Each side's progress: bytes, packets and elements it has ever written or read. These only grow, so what's held is
+  // always head minus tail. The writer publishes head and the reader publishes tail, each on its own cache line and
+  // with plain stores, so neither side ever modifies a line the other writes.
+  Cursor head;
+  Cursor tail;
+
+  // The writer's own position, and the reader's progress as it last saw it, only looked at again when short of space.
+  alignas(CACHE_LINE_SIZE) std::size_t write_offset;
+  std::size_t write_position;
+  std::size_t metadata_write;
+  std::size_t write_elements;
+  std::size_t seen_read_position;
+  std::size_t seen_metadata_read;
+
+  // The reader's own position, and the writer's progress as it last saw it, only looked at again when out of packets.
+  alignas(CACHE_LINE_SIZE) std::size_t read_offset;
+  std::size_t read_position;
+  std::size_t metadata_read;
+  std::size_t read_elements;
+  std::size_t seen_metadata_write;
+  std::size_t resident_packet;
+
+  // Metrics are counted by the thread that owns them, and published for GetMetrics to snapshot from any thread.
+  enum WriterCounter : std::size_t {
+    CONCEALED_FRAMES,
+    FILLED_PACKETS,
+    UPDATED_FRAMES,
+    UPDATE_MISSED_FRAMES,
+    ENQUEUED_ELEMENTS,
+    DROPPED_PACKETS,
+    DUPLICATE_PACKETS,
+    WRITER_COUNTERS,
+  };
+  enum ReaderCounter : std::size_t {
+    SKIPPED_FRAMES,
+    DEQUEUED_ELEMENTS,
+    ACCELERATED_ELEMENTS,
+    DECELERATED_ELEMENTS,
+    READER_COUNTERS,
+  };
+  // Only taken when there may be multiple producers. Held from a successful ReserveWrite until its CommitWrite.
+  bool multiple_producers;
+  std::mutex producer_mutex;
+  std::unique_lock<std::mutex> reservation_lock;
+  // The thread holding the reservation, so others can't take its lock from it.
+  std::atomic<std::thread::id> reservation_owner;
+
+  // A sleeping reader arms the notification, and the writer wakes it after its next write.
+  bool notifications;
+  std::atomic<bool> notify_armed;
+  std::mutex notify_mutex;
+  std::condition_variable notify_condition;
+  std::unique_ptr<NotificationFd> notification_fd;
+
+  CounterBlock<WRITER_COUNTERS> writer_metrics;
+  CounterBlock<READER_COUNTERS> reader_metrics;
+  Histograms histograms;
+  std::optional<std::chrono::nanoseconds> last_arrival_time;
+  std::int64_t last_arrival_start;
+
+  std::size_t DoPrepare(std::uint32_t sequence_number, ConcealmentRef concealment_callback);
+  std::size_t DoEnqueue(const Packet *packets, std::size_t count, ConcealmentRef concealment_callback);
+  std::size_t DoCommitWrite(ConcealmentRef concealment_callback);
+  std::size_t GenerateConcealment(std::size_t packets, ConcealmentRef callback, std::chrono::nanoseconds now);
   std::size_t Update(const Packet &packet);
-  std::size_t CopyIntoBuffer(const Packet &packet);
+  void Arrived(std::uint32_t sequence_number, std::size_t elements, std::chrono::nanoseconds now);
+  std::chrono::nanoseconds MediaTime(std::int64_t elements) const;
+  void Index(std::uint32_t sequence_number, std::size_t packet, std::size_t position, std::size_t elements, bool concealment);
+  void WriteHeader(std::size_t packet, std::uint32_t sequence_number, std::size_t elements, std::chrono::nanoseconds timestamp, bool concealment);
+  /// @brief How Read converts what it copies out. Planar destinations hold plane_elements per channel.
+  struct Conversion {
+    const SampleFormat &source;
+    const SampleFormat &destination;
+    std::size_t plane_elements;
+  };
+  std::size_t Read(std::uint8_t *destination, std::size_t elements, std::chrono::nanoseconds now, const Conversion *conversion = nullptr);
+  std::optional<ReadView> Peek(std::size_t elements, std::chrono::nanoseconds now);
+  void Consume(std::size_t elements);
+  std::size_t Stretch(std::uint8_t *destination, std::size_t elements, std::chrono::nanoseconds now);
+  std::size_t MixInto(std::uint8_t *destination, std::size_t elements, SampleType type, float gain, std::chrono::nanoseconds now);
+  std::size_t Resample(std::uint8_t *destination, std::size_t elements, std::chrono::nanoseconds now);
+  /// @brief Dequeue's source of elements: resampled, stretched or read straight.
+  std::size_t Pull(std::uint8_t *destination, std::size_t elements, std::chrono::nanoseconds now);
+  void ReleaseHead();
+  void DropHead();
+  std::size_t FillToMinimum(ConcealmentRef callback, std::chrono::nanoseconds now);
+  std::size_t CopyIntoBuffer(const Packet &packet, std::chrono::nanoseconds now);
+  std::size_t Publish(std::uint32_t sequence_number, std::size_t elements, bool concealment, std::chrono::nanoseconds now);
   std::size_t CopyIntoBuffer(const std::uint8_t *source, std::size_t length, bool manual_increment, std::size_t offset_offset_bytes);
-  std::size_t CopyOutOfBuffer(std::uint8_t *destination, std::size_t length, std::size_t required_bytes, bool strict);
-  void UnwindRead(std::size_t unwind_bytes);
   void ForwardRead(std::size_t forward_bytes);
-  void UnwindWrite(std::size_t unwind_bytes);
   void ForwardWrite(std::size_t forward_bytes);
-  [[nodiscard]] static void *MakeVirtualMemory(std::size_t &length, void *user_data);
-  static void FreeVirtualMemory(void *address, std::size_t length, void *user_data);
+  void PublishHead(std::chrono::nanoseconds now);
+  void PublishTail();
+  std::size_t FreeBytes(std::size_t wanted);
+  std::size_t FreeHeaders(std::size_t wanted);
+  const PendingSlot *OldestPending();
+  std::size_t HeldElements() const;
+
+  void Notify();
+  void Arm();
+
+  /// @brief Lock out other producers, if there may be any.
+  std::unique_lock<std::mutex> LockProducers() {
+    return multiple_producers ? std::unique_lock<std::mutex>(producer_mutex) : std::unique_lock<std::mutex>();
+  }
+  void FreeRing();
+
+  /// @brief Offset into the ring, wrapped to its capacity.
+  constexpr std::size_t Wrap(const std::size_t offset) const {
+    if constexpr (CapacityBytes != std::dynamic_extent && std::has_single_bit(CapacityBytes)) {
+      return offset & (CapacityBytes - 1);
+    } else {
+      return offset % GetCapacity();
+    }
+  }
+
+  /// @brief Adapts a vector concealment callback to the span the buffer provides.
+  static auto VectorConcealment(const ConcealmentCallback &callback) {
+    return [&callback](const std::span<Packet> packets) {
+      std::vector<Packet> vector(packets.begin(), packets.end());
+      callback(vector);
+    };
+  }
 };
+
+/// @brief A jitter buffer with all sizes given at runtime.
+using JitterBuffer = BasicJitterBuffer<>;
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::BasicJitterBuffer(const std::size_t element_size,
+                                                                                         const std::size_t packet_elements,
+                                                                                         const std::uint32_t clock_rate,
+                                                                                         const std::chrono::milliseconds max_length,
+                                                                                         const std::chrono::milliseconds min_length,
+                                                                                         const cantina::LoggerPointer &logger,
+                                                                                         const Clock &clock,
+                                                                                         const std::shared_ptr<RingArena> &arena)
+    : logger(std::make_shared<cantina::Logger>("JTTR", logger)),
+      clock(clock ? clock : SteadyClock),
+      element_size(element_size),
+      packet_elements(packet_elements),
+      clock_rate(clock_rate),
+      min_length(min_length),
+      max_length(max_length),
+      target_depth(min_length),
+      vm_user_data(nullptr),
+      arena(arena),
+      backing(RingBacking::Standard),
+      peeked_elements(0),
+      peeked_in_use(false),
+      reserved_elements(0),
+      concealment_worker(0),
+      pending_begin(0),
+      pending_end(0),
+      stretch_lookahead(0),
+      stretch_elements(0),
+      drift_format{SampleType::Int16, SampleLayout::Interleaved, 0},
+      resample_elements(0),
+      resample_position(1),
+      produced_elements(0),
+      smoothed_depth(0),
+      clock_drift(0),
+      write_offset(0),
+      write_position(0),
+      metadata_write(0),
+      write_elements(0),
+      seen_read_position(0),
+      seen_metadata_read(0),
+      read_offset(0),
+      read_position(0),
+      metadata_read(0),
+      read_elements(0),
+      seen_metadata_write(0),
+      resident_packet(NO_POSITION),
+      multiple_producers(false),
+      notifications(false),
+      notify_armed(false),
+      last_arrival_start(0) {
+
+  // Sizes fixed at compile time must match those given.
+  if (ElementSizeBytes != std::dynamic_extent && element_size != ElementSizeBytes) {
+    std::ostringstream message;
+    message << "Element size must be " << ElementSizeBytes << ", got: " << element_size;
+    throw std::invalid_argument(message.str());
+  }
+  if (PacketElementCount != std::dynamic_extent && packet_elements != PacketElementCount) {
+    std::ostringstream message;
+    message << "Packet elements must be " << PacketElementCount << ", got: " << packet_elements;
+    throw std::invalid_argument(message.str());
+  }
+
+  // Packets should be at least 1ms.
+  const std::chrono::milliseconds each_packet = std::chrono::milliseconds(packet_elements * 1000 / clock_rate);
+  if (each_packet.count() < 1) {
+    throw std::invalid_argument("Packets should be at least 1ms.");
+  }
+
+  // Packet lengths must fit in a header.
+  if (packet_elements > std::numeric_limits<decltype(Header::elements)>::max()) {
+    throw std::invalid_argument("Packets should be at most 65535 elements.");
+  }
+
+  // Ensure atomic variables are lock free.
+  static_assert(std::atomic<std::size_t>::is_always_lock_free);
+  static_assert(std::atomic<std::uint16_t>::is_always_lock_free);
+  static_assert(sizeof(Header) == 16);
+
+  // VM Address trick for automatic wrap around. The ring only holds elements, headers live in their own table.
+  // A fixed capacity replaces the size derived from max_length.
+  const std::size_t buffer_size = CapacityBytes == std::dynamic_extent ? max_length.count() * (clock_rate / 1000) * element_size : CapacityBytes;
+  max_size_bytes = buffer_size;
+  if (arena) {
+    const Ring ring = arena->Allocate(max_size_bytes);
+    buffer = ring.address;
+    max_size_bytes = ring.length;
+    backing = ring.backing;
+  } else {
+#if _GNU_SOURCE
+    vm_user_data = calloc(1, sizeof(int));
+#endif
+    buffer = reinterpret_cast<std::uint8_t *>(VirtualMemory::Make(max_size_bytes, vm_user_data));
+  }
+  if (CapacityBytes != std::dynamic_extent && max_size_bytes != CapacityBytes) {
+    FreeRing();
+    std::ostringstream message;
+    message << "Capacity must be a multiple of the page size. Got: " << CapacityBytes << ", would be: " << max_size_bytes;
+    throw std::invalid_argument(message.str());
+  }
+
+  // One header for every packet that could be held, plus a partially read one, in cache line aligned storage.
+  // Packet durations vary, so allow for the buffer to be full of the shortest packets expected, 1ms.
+  const std::size_t shortest_packet = std::max<std::size_t>(clock_rate / 1000, 1);
+  const std::size_t max_packets = (max_size_bytes / (shortest_packet * element_size)) + 1;
+  metadata_capacity = max_packets;
+  const std::size_t metadata_bytes = ((max_packets * METADATA_SIZE) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  metadata = static_cast<Header *>(std::aligned_alloc(CACHE_LINE_SIZE, metadata_bytes));
+  if (metadata == nullptr) {
+    throw std::bad_alloc();
+  }
+  for (std::size_t slot = 0; slot < metadata_capacity; slot++) {
+    new (&metadata[slot]) Header();
+  }
+
+  // Concealment can't generate more packets than there are headers for, so this never needs to grow.
+  concealment_packets = std::vector<Packet>(max_packets);
+
+  // Index every packet that could be held, by sequence number.
+  index = std::vector<IndexEntry>(max_packets, IndexEntry{.sequence_number = 0, .packet = NO_POSITION, .position = 0, .elements = 0, .concealment = false});
+
+  // Done.
+  memset(buffer, 0, max_size_bytes);
+  last_written_sequence_number.reset();
+  last_packet_elements = packet_elements;
+  reader_packet_elements.store(packet_elements, std::memory_order::relaxed);
+  newest_arrival.reset();
+  newest_arrival_start = 0;
+  newest_arrival_end = 0;
+  logger->debug << "Allocated JitterBuffer with: " << max_size_bytes << " bytes"
+                << (backing == RingBacking::Huge ? " of huge pages" : backing == RingBacking::TransparentHuge ? " of transparent huge pages" : "")
+                << std::flush;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::~BasicJitterBuffer() {
+  // Workers may still be writing concealment into the ring.
+  if (concealment_workers) {
+    concealment_workers->Drain(concealment_worker);
+  }
+  FreeRing();
+  std::free(metadata);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::FreeRing() {
+  if (arena) {
+    arena->Release({buffer, max_size_bytes, backing});
+  } else {
+    VirtualMemory::Free(buffer, max_size_bytes, vm_user_data);
+  }
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Prepare(const std::uint32_t sequence_number, const ConcealmentCallback &concealment_callback) {
+  auto adapter = VectorConcealment(concealment_callback);
+  return DoPrepare(sequence_number, ConcealmentRef(adapter));
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::DoPrepare(const std::uint32_t sequence_number, const ConcealmentRef concealment_callback) {
+  const std::unique_lock<std::mutex> lock = LockProducers();
+  if (!last_written_sequence_number.has_value()) {
+    // Nothing to do.
+    return 0;
+  }
+
+  const unsigned long last = last_written_sequence_number.value();
+  if (sequence_number <= last) {
+    // Might be an update, nothing to do.
+    return 0;
+  }
+
+  if (sequence_number == last + 1) {
+    // This is the next packet, nothing to do.
+    return 0;
+  }
+
+  // In all other cases, we're missing packets.
+  const std::size_t missing_packets = sequence_number - last - 1;
+  const std::size_t concealed_frames = GenerateConcealment(missing_packets, concealment_callback, clock());
+  writer_metrics.Add(CONCEALED_FRAMES, concealed_frames);
+  writer_metrics.Publish();
+  if (concealed_frames > 0) {
+    Notify();
+  }
+  return concealed_frames;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Enqueue(const std::vector<Packet> &packets, const ConcealmentCallback &concealment_callback) {
+  return Enqueue(packets.data(), packets.size(), concealment_callback);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Enqueue(const Packet *packets, const std::size_t count, const ConcealmentCallback &concealment_callback) {
+  auto adapter = VectorConcealment(concealment_callback);
+  return DoEnqueue(packets, count, ConcealmentRef(adapter));
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::DoEnqueue(const Packet *packets, const std::size_t count, const ConcealmentRef concealment_callback) {
+  const std::unique_lock<std::mutex> lock = LockProducers();
+  std::size_t enqueued = 0;
+  const std::chrono::nanoseconds now = clock();
+
+  for (std::size_t packet_index = 0; packet_index < count; packet_index++) {
+    const Packet &packet = packets[packet_index];
+    // TODO: Handle sequence rollover.
+    Arrived(packet.sequence_number, packet.elements, now);
+    if (packet.sequence_number <= last_written_sequence_number) {
+      // This might be an update for an existing concealment packet.
+      // Update it and continue on.
+      enqueued += Update(packet);
+      continue;
+    } else if (last_written_sequence_number.has_value() && packet.sequence_number != last_written_sequence_number) {
+      const std::size_t last = last_written_sequence_number.value();
+      const std::size_t missing = packet.sequence_number - last - 1;
+      if (missing > 0) {
+        const auto concealed = GenerateConcealment(missing, concealment_callback, now);
+        enqueued += concealed;
+        writer_metrics.Add(CONCEALED_FRAMES, concealed);
+      }
+    }
+
+    // Enqueue this packet of real data.
+    if (packet.elements == 0) {
+      throw std::invalid_argument("Packets should have at least 1 element.");
+    }
+    if (packet.elements > std::numeric_limits<decltype(Header::elements)>::max()) {
+      std::ostringstream message;
+      message << "Packets should be at most 65535 elements. Got: " << packet.elements;
+      throw std::invalid_argument(message.str());
+    }
+    const std::size_t enqueued_elements = CopyIntoBuffer(packet, now);
+    if (enqueued_elements == 0 && packet.elements > 0) {
+      // There's no more space.
+      logger->warning << "Enqueue has no more space. This packet will be lost " << packet.sequence_number << std::flush;
+      writer_metrics.Add(DROPPED_PACKETS, count - packet_index);
+      break;
+    }
+    writer_metrics.Add(ENQUEUED_ELEMENTS, enqueued_elements);
+    enqueued += enqueued_elements;
+    last_written_sequence_number = packet.sequence_number;
+    last_packet_elements = packet.elements;
+    reader_packet_elements.store(last_packet_elements, std::memory_order::relaxed);
+  }
+
+  enqueued += FillToMinimum(concealment_callback, now);
+  writer_metrics.Publish();
+  if (enqueued > 0) {
+    Notify();
+  }
+  return enqueued;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::uint8_t *BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::ReserveWrite(const std::uint32_t sequence_number, const std::size_t elements) {
+  if (elements == 0) {
+    throw std::invalid_argument("Packets should have at least 1 element.");
+  }
+  if (elements > std::numeric_limits<decltype(Header::elements)>::max()) {
+    std::ostringstream message;
+    message << "Packets should be at most 65535 elements. Got: " << elements;
+    throw std::invalid_argument(message.str());
+  }
+  // Checked before locking, as the producer lock isn't recursive.
+  if (reservation_owner.load(std::memory_order::relaxed) == std::this_thread::get_id()) {
+    throw std::runtime_error("A write is already reserved");
+  }
+  std::unique_lock<std::mutex> lock = LockProducers();
+  if (reserved_elements > 0) {
+    throw std::runtime_error("A write is already reserved");
+  }
+
+  // Only the next packets can be written in place, updates must go through Enqueue.
+  if (sequence_number <= last_written_sequence_number) {
+    return nullptr;
+  }
+
+  // The packet itself must fit, and ideally anything missing before it.
+  const std::size_t missing = last_written_sequence_number.has_value() ? sequence_number - last_written_sequence_number.value() - 1 : 0;
+  const std::size_t concealment_packet_size = last_packet_elements * GetElementSize();
+  const std::size_t packet_size = elements * GetElementSize();
+  const std::size_t space = FreeBytes(packet_size + (missing * concealment_packet_size));
+  const std::size_t headers = FreeHeaders(missing + 1);
+  if (packet_size > space || headers == 0) {
+    logger->warning << "ReserveWrite has no more space for " << sequence_number << std::flush;
+    writer_metrics.Add(DROPPED_PACKETS, 1);
+    writer_metrics.Publish();
+    return nullptr;
+  }
+
+  // Leave room in front of it for as many missing packets as will fit.
+  const std::size_t to_conceal = std::min({missing, (space - packet_size) / concealment_packet_size, headers - 1});
+  if (to_conceal != missing) {
+    logger->warning << "Couldn't fit all missing. Reserving: " << to_conceal << "/" << missing << std::flush;
+  }
+
+  reserved_sequence_number = sequence_number;
+  reserved_elements = elements;
+  reserved_concealment = to_conceal;
+  reservation_lock = std::move(lock);
+  reservation_owner.store(std::this_thread::get_id(), std::memory_order::relaxed);
+  const std::size_t offset = write_offset + (to_conceal * last_packet_elements * GetElementSize());
+  return buffer + Wrap(offset);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::CommitWrite(const ConcealmentCallback &concealment_callback) {
+  auto adapter = VectorConcealment(concealment_callback);
+  return DoCommitWrite(ConcealmentRef(adapter));
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::DoCommitWrite(const ConcealmentRef concealment_callback) {
+  // Take the reservation's lock first, so it's released however this ends. Any other thread waits its turn like a
+  // write, and then finds nothing reserved.
+  const std::unique_lock<std::mutex> lock = reservation_owner.load(std::memory_order::relaxed) == std::this_thread::get_id() ? std::move(reservation_lock) : LockProducers();
+  reservation_owner.store(std::thread::id(), std::memory_order::relaxed);
+  if (reserved_elements == 0) {
+    throw std::runtime_error("No write reserved");
+  }
+  const std::size_t elements = reserved_elements;
+  reserved_elements = 0;
+
+  // Fill the gap in front of the reserved packet.
+  std::size_t enqueued = 0;
+  const std::chrono::nanoseconds now = clock();
+  if (reserved_concealment > 0) {
+    const std::size_t concealed = GenerateConcealment(reserved_concealment, concealment_callback, now);
+    assert(concealed == reserved_concealment * last_packet_elements);
+    enqueued += concealed;
+    writer_metrics.Add(CONCEALED_FRAMES, concealed);
+  }
+
+  // The data is already in place, publish it.
+  Arrived(reserved_sequence_number, elements, now);
+  enqueued += Publish(reserved_sequence_number, elements, false, now);
+  writer_metrics.Add(ENQUEUED_ELEMENTS, elements);
+  last_written_sequence_number = reserved_sequence_number;
+  last_packet_elements = elements;
+  reader_packet_elements.store(last_packet_elements, std::memory_order::relaxed);
+  enqueued += FillToMinimum(concealment_callback, now);
+  writer_metrics.Publish();
+  if (enqueued > 0) {
+    Notify();
+  }
+  return enqueued;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::FillToMinimum(const ConcealmentRef concealment_callback, const std::chrono::nanoseconds now) {
+  // Now that we've written, check the fill level.
+  // If it's below 1/2 the min fill level, we need to conceal.
+  std::size_t enqueued = 0;
+  const std::chrono::milliseconds gap_to_min = (GetTargetDepth() / 2) - GetCurrentDepth();
+  if (play && gap_to_min.count() > 0) {
+    // How many packets would cover this gap?
+    // In nanoseconds, as packets can be shorter than a millisecond.
+    const std::chrono::nanoseconds each_packet = std::chrono::nanoseconds(last_packet_elements * 1000000000 / clock_rate.count());
+    assert(each_packet.count() > 0);
+    const std::chrono::nanoseconds gap = gap_to_min;
+    const std::size_t to_conceal = (gap.count() + each_packet.count() - 1) / each_packet.count();
+    const auto concealed = GenerateConcealment(to_conceal, concealment_callback, now);
+    enqueued += concealed;
+    writer_metrics.Add(FILLED_PACKETS, concealed);
+  }
+
+  // If we're waiting to play, is it time to play?
+  if (!play && GetCurrentDepth() >= GetTargetDepth()) {
+    play = true;
+  }
+
+  return enqueued;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Dequeue(std::uint8_t *destination, const std::size_t &destination_length, const std::size_t &elements) {
+  return Dequeue(destination, destination_length, elements, clock());
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Dequeue(std::uint8_t *destination, const std::size_t &destination_length, const std::size_t &elements, const std::chrono::nanoseconds now) {
+
+  if (!play) {
+    return 0;
+  }
+
+  // Check the destination buffer is big enough.
+  const std::size_t required_bytes = elements * GetElementSize();
+  if (destination_length < required_bytes) {
+    std::ostringstream message;
+    message << "Provided buffer too small. Was: " << destination_length << ", need: " << required_bytes;
+    throw std::invalid_argument(message.str());
+  }
+
+  histograms.depth.Record(HeldElements() * 1000000 / clock_rate.count());
+  const std::size_t dequeued = Pull(destination, elements, now);
+  reader_metrics.Publish();
+  return dequeued;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Dequeue(std::uint8_t *destination, const std::size_t destination_length, const std::size_t elements, const SampleFormat &source_format, const SampleFormat &destination_format) {
+  return Dequeue(destination, destination_length, elements, source_format, destination_format, clock());
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Dequeue(std::uint8_t *destination, const std::size_t destination_length, const std::size_t elements, const SampleFormat &source_format, const SampleFormat &destination_format, const std::chrono::nanoseconds now) {
+  if (source_format.layout != SampleLayout::Interleaved || source_format.GetElementSize() != GetElementSize()) {
+    std::ostringstream message;
+    message << "Source format must be interleaved, with elements of " << GetElementSize() << " bytes. Got: " << source_format.GetElementSize();
+    throw std::invalid_argument(message.str());
+  }
+  if (source_format.channels != destination_format.channels) {
+    std::ostringstream message;
+    message << "Destination format must have " << source_format.channels << " channels. Got: " << destination_format.channels;
+    throw std::invalid_argument(message.str());
+  }
+
+  if (!play) {
+    return 0;
+  }
+
+  const std::size_t required_bytes = elements * destination_format.GetElementSize();
+  if (destination_length < required_bytes) {
+    std::ostringstream message;
+    message << "Provided buffer too small. Was: " << destination_length << ", need: " << required_bytes;
+    throw std::invalid_argument(message.str());
+  }
+
+  histograms.depth.Record(HeldElements() * 1000000 / clock_rate.count());
+  std::size_t dequeued;
+  if (time_stretch || drift_estimator.has_value()) {
+    if (convert_buffer.size() < elements * GetElementSize()) {
+      convert_buffer.resize(elements * GetElementSize());
+    }
+    dequeued = Pull(convert_buffer.data(), elements, now);
+    ConvertSamples(convert_buffer.data(), source_format, 0, destination, destination_format, elements, dequeued);
+  } else {
+    const Conversion conversion = {source_format, destination_format, elements};
+    dequeued = Read(destination, elements, now, &conversion);
+  }
+  reader_metrics.Publish();
+  return dequeued;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::DequeueMix(const std::span<const MixSource> sources, const SampleType type, std::uint8_t *destination, const std::size_t destination_length, const std::size_t elements) {
+  if (type != SampleType::Int16 && type != SampleType::Float32) {
+    throw std::invalid_argument("Only int16 and float samples can be mixed");
+  }
+  if (sources.empty()) {
+    throw std::invalid_argument("Need at least one source to mix");
+  }
+  const std::size_t element_size = sources.front().buffer->GetElementSize();
+  const std::size_t sample_size = SampleFormat{type, SampleLayout::Interleaved, 1}.GetSampleSize();
+  for (const MixSource &source: sources) {
+    if (source.buffer->GetElementSize() != element_size || element_size % sample_size != 0) {
+      std::ostringstream message;
+      message << "Sources must share an element size that is a whole number of samples. Was: " << source.buffer->GetElementSize() << ", expected: " << element_size;
+      throw std::invalid_argument(message.str());
+    }
+  }
+  const std::size_t required_bytes = elements * element_size;
+  if (destination_length < required_bytes) {
+    std::ostringstream message;
+    message << "Provided buffer too small. Was: " << destination_length << ", need: " << required_bytes;
+    throw std::invalid_argument(message.str());
+  }
+
+  memset(destination, 0, required_bytes);
+  std::size_t mixed = 0;
+  for (const MixSource &source: sources) {
+    mixed = std::max(mixed, source.buffer->MixInto(destination, elements, type, source.gain, source.buffer->clock()));
+  }
+  return mixed;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::MixInto(std::uint8_t *destination, const std::size_t elements, const SampleType type, const float gain, const std::chrono::nanoseconds now) {
+  if (!play) {
+    return 0;
+  }
+
+  histograms.depth.Record(HeldElements() * 1000000 / clock_rate.count());
+  const std::size_t samples_per_element = GetElementSize() / SampleFormat{type, SampleLayout::Interleaved, 1}.GetSampleSize();
+  std::size_t mixed = 0;
+  if (time_stretch || drift_estimator.has_value()) {
+    if (convert_buffer.size() < elements * GetElementSize()) {
+      convert_buffer.resize(elements * GetElementSize());
+    }
+    mixed = Pull(convert_buffer.data(), elements, now);
+    MixSamples(convert_buffer.data(), type, gain, destination, mixed * samples_per_element);
+  } else {
+    // As Read, but adding rather than copying.
+    while (mixed < elements) {
+      const std::optional<ReadView> view = Peek(elements - mixed, now);
+      if (!view.has_value()) {
+        break;
+      }
+      MixSamples(view->data, type, gain, destination + (mixed * GetElementSize()), view->elements * samples_per_element);
+      Consume(view->elements);
+      mixed += view->elements;
+    }
+  }
+  reader_metrics.Publish();
+  return mixed;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Pull(std::uint8_t *destination, const std::size_t elements, const std::chrono::nanoseconds now) {
+  if (drift_estimator.has_value()) {
+    return Resample(destination, elements, now);
+  }
+  return time_stretch ? Stretch(destination, elements, now) : Read(destination, elements, now);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Resample(std::uint8_t *destination, const std::size_t elements, const std::chrono::nanoseconds now) {
+  // Everything written, including concealment, stands in for the sender's clock, and everything played out for ours.
+  // A publish landing between these loads pairs a total with its neighbour's time, which the fit averages out.
+  const std::size_t written = head.elements.load(std::memory_order::acquire);
+  if (written > 0) {
+    drift_estimator->Arrived(written, std::chrono::nanoseconds(head.time.load(std::memory_order::relaxed)));
+  }
+  const std::optional<double> drift = drift_estimator->GetDrift();
+  clock_drift.store(drift.value_or(0) * 1e6, std::memory_order::relaxed);
+
+  // Consume at the drifted rate, nudged toward the target depth.
+  smoothed_depth += (static_cast<double>(HeldElements()) - smoothed_depth) * DEPTH_SMOOTHING;
+  const double target = static_cast<double>(GetTargetDepth().count() * clock_rate.count()) / 1000;
+  const double correction = (smoothed_depth - target) / (DEPTH_CORRECTION_TIME.count() * static_cast<double>(clock_rate.count()));
+  const double step = 1 + std::clamp(drift.value_or(0) + correction, -MAX_RATE_CORRECTION, MAX_RATE_CORRECTION);
+
+  // Top up with enough source for every output: each reads one element before its position, and two after.
+  const std::size_t needed = static_cast<std::size_t>(resample_position + (static_cast<double>(elements - 1) * step)) + 3;
+  if (resample_buffer.size() < needed * GetElementSize()) {
+    resample_buffer.resize(needed * GetElementSize());
+  }
+  if (resample_elements < needed) {
+    std::uint8_t *into = resample_buffer.data() + (resample_elements * GetElementSize());
+    resample_elements += time_stretch ? Stretch(into, needed - resample_elements, now) : Read(into, needed - resample_elements, now);
+  }
+
+  // Produce as much as the source covers.
+  std::size_t produced = elements;
+  if (resample_elements < needed) {
+    const double last = static_cast<double>(resample_elements) - 3;
+    produced = last < resample_position ? 0 : std::min(elements, static_cast<std::size_t>((last - resample_position) / step) + 1);
+  }
+  // Starved means the sender has gone quiet, which says nothing about either clock, so leave the gap out.
+  produced_elements += produced;
+  if (produced == elements) {
+    drift_estimator->Consumed(produced_elements, now);
+  } else {
+    drift_estimator->Interrupted();
+  }
+  if (produced == 0) {
+    return 0;
+  }
+  InterpolateSamples(resample_buffer.data(), drift_format, resample_position, step, destination, produced);
+
+  // Drop source no longer needed, keeping the element before the next position.
+  const double next = resample_position + (static_cast<double>(produced) * step);
+  const std::size_t drop = std::min(static_cast<std::size_t>(next) - 1, resample_elements);
+  memmove(resample_buffer.data(), resample_buffer.data() + (drop * GetElementSize()), (resample_elements - drop) * GetElementSize());
+  resample_elements -= drop;
+  resample_position = next - static_cast<double>(drop);
+  return produced;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Read(std::uint8_t *destination, const std::size_t elements, const std::chrono::nanoseconds now, const Conversion *conversion) {
+  std::size_t dequeued_elements = 0;
+  while (dequeued_elements < elements) {
+    // Copy out as much real data as the next packet has.
+    const std::optional<ReadView> view = Peek(elements - dequeued_elements, now);
+    if (!view.has_value()) {
+      break;
+    }
+    assert(view->elements > 0);// Because we got a view, we should get *something*.
+    if (conversion == nullptr) {
+      memcpy(destination + (dequeued_elements * GetElementSize()), view->data, view->elements * GetElementSize());
+    } else {
+      // Planar output carries on along each plane, rather than past everything written so far.
+      const SampleFormat &format = conversion->destination;
+      const std::size_t advance = format.layout == SampleLayout::Planar ? format.GetSampleSize() : format.GetElementSize();
+      ConvertSamples(view->data, conversion->source, 0, destination + (dequeued_elements * advance), format, conversion->plane_elements, view->elements);
+    }
+    Consume(view->elements);
+    dequeued_elements += view->elements;
+  }
+
+  assert(dequeued_elements <= elements);// We should not get more than asked for.
+  return dequeued_elements;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Stretch(std::uint8_t *destination, const std::size_t elements, const std::chrono::nanoseconds now) {
+  const std::chrono::milliseconds depth = GetCurrentDepth();
+  const std::chrono::milliseconds target = GetTargetDepth();
+  // Packets vary, so the dead band follows the most recent one.
+  const std::size_t newest_elements = reader_packet_elements.load(std::memory_order::relaxed);
+  const std::chrono::milliseconds each_packet = std::chrono::milliseconds(newest_elements * 1000 / clock_rate.count());
+  const bool accelerate = depth > target + each_packet;
+  const bool decelerate = depth + each_packet < target;
+
+  // Nothing to do and nothing held back, read straight through.
+  if (!accelerate && !decelerate && stretch_elements == 0) {
+    return Read(destination, elements, now);
+  }
+
+  // Gather enough elements to stretch, after any held back from last time.
+  const std::size_t wanted = elements + (accelerate ? stretch_lookahead : 0);
+  if (stretch_buffer.size() < wanted * GetElementSize()) {
+    stretch_buffer.resize(wanted * GetElementSize());
+  }
+  if (stretch_elements < wanted) {
+    stretch_elements += Read(stretch_buffer.data() + (stretch_elements * GetElementSize()), wanted - stretch_elements, now);
+  }
+
+  std::size_t consumed;
+  std::size_t produced;
+  if ((accelerate && stretch_elements > elements) || (decelerate && stretch_elements >= elements)) {
+    const std::size_t offered = accelerate ? stretch_elements : elements;
+    consumed = std::min(time_stretch(stretch_buffer.data(), offered, destination, elements), offered);
+    produced = elements;
+    if (consumed > produced) {
+      reader_metrics.Add(ACCELERATED_ELEMENTS, consumed - produced);
+    } else {
+      reader_metrics.Add(DECELERATED_ELEMENTS, produced - consumed);
+    }
+  } else {
+    consumed = std::min(stretch_elements, elements);
+    produced = consumed;
+    memcpy(destination, stretch_buffer.data(), produced * GetElementSize());
+  }
+
+  // Hold back whatever wasn't consumed for next time.
+  stretch_elements -= consumed;
+  memmove(stretch_buffer.data(), stretch_buffer.data() + (consumed * GetElementSize()), stretch_elements * GetElementSize());
+  return produced;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::optional<ReadView> BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::PeekRead(const std::size_t elements) {
+  return PeekRead(elements, clock());
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::optional<ReadView> BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::PeekRead(const std::size_t elements, const std::chrono::nanoseconds now) {
+  const std::optional<ReadView> view = Peek(elements, now);
+  reader_metrics.Publish();
+  return view;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::optional<ReadView> BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Peek(const std::size_t elements, const std::chrono::nanoseconds now) {
+  if (!play || elements == 0) {
+    return std::nullopt;
+  }
+
+  if (peeked_elements > 0) {
+    // We already hold the head packet, hand it back out.
+    const Header &header = metadata[metadata_read % metadata_capacity];
+    return ReadView{
+            .data = buffer + read_offset,
+            .elements = std::min(elements, peeked_elements),
+            .sequence_number = header.sequence_number,
+            .concealment = (header.state.load(std::memory_order::acquire) & Header::CONCEALMENT) != 0,
+    };
+  }
+
+  while (metadata_read < seen_metadata_write || metadata_read < (seen_metadata_write = head.packets.load(std::memory_order::acquire))) {
+    Header &header = metadata[metadata_read % metadata_capacity];
+    assert(header.elements > 0);
+
+    // If this is concealement, check the use flag.
+    std::uint16_t state = header.state.load(std::memory_order::acquire);
+    if (state & Header::CONCEALMENT) {
+      state = header.state.fetch_or(Header::IN_USE, std::memory_order::acquire);
+      if (state & (Header::IN_USE | Header::PENDING)) {
+        // This packet is currently being updated from concealment data to real data, or still being synthesized.
+        // It's not safe for us to read it - skip to the next available packet.
+        if (!(state & Header::IN_USE)) {
+          header.state.fetch_and(~Header::IN_USE, std::memory_order::release);
+        }
+        logger->warning << "[" << header.sequence_number << "] Dequeue: Can't read concealment packet because it's being "
+                        << (state & Header::PENDING ? "synthesized." : "updated.") << std::flush;
+        DropHead();
+        continue;
+      }
+      peeked_in_use = true;
+    }
+
+    const std::chrono::nanoseconds age = now - std::chrono::nanoseconds(header.timestamp);
+    if (age >= max_length) {
+      // It's too old, throw this away and run to the next.
+      reader_metrics.Add(SKIPPED_FRAMES, header.elements);
+      ReleaseHead();
+      DropHead();
+      continue;
+    }
+
+    // Note how long the packet waited, the first time any of it is read.
+    if (resident_packet != metadata_read) {
+      histograms.residence.Record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(age).count()));
+      resident_packet = metadata_read;
+    }
+
+    // Nothing real turned up in time, so synthesize it now. We hold it, so the writer can't update it underneath us.
+    if (state & Header::PLACEHOLDER) {
+      Packet packet = {
+              .sequence_number = header.sequence_number,
+              .data = buffer + read_offset,
+              .length = header.elements * GetElementSize(),
+              .elements = header.elements,
+      };
+      lazy_concealment(std::span<Packet>(&packet, 1));
+      header.state.fetch_and(~Header::PLACEHOLDER, std::memory_order::relaxed);
+    }
+
+    // This packet is now ours until it's committed.
+    peeked_elements = header.elements;
+    return ReadView{
+            .data = buffer + read_offset,
+            .elements = std::min(elements, peeked_elements),
+            .sequence_number = header.sequence_number,
+            .concealment = (state & Header::CONCEALMENT) != 0,
+    };
+  }
+  return std::nullopt;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::CommitRead(const std::size_t elements) {
+  Consume(elements);
+  reader_metrics.Publish();
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Consume(const std::size_t elements) {
+  // Without a view there's nothing to release, and the head packet may not even exist yet.
+  if (peeked_elements == 0) {
+    if (elements > 0) {
+      throw std::runtime_error("No read peeked");
+    }
+    return;
+  }
+  if (elements > peeked_elements) {
+    std::ostringstream message;
+    message << "Can't commit more elements than were peeked. Got: " << elements << ", peeked: " << peeked_elements;
+    throw std::invalid_argument(message.str());
+  }
+  peeked_elements = 0;
+
+  // Headers never move, partial reads just shrink them.
+  // The index records where the packet started, so updates can find what's left.
+  Header &header = metadata[metadata_read % metadata_capacity];
+  if (elements > 0) {
+    header.elements -= elements;
+    ForwardRead(elements * GetElementSize());
+    read_elements += elements;
+    reader_metrics.Add(DEQUEUED_ELEMENTS, elements);
+  }
+  ReleaseHead();
+
+  // Once fully consumed, move on to the next packet.
+  if (header.elements == 0) {
+    metadata_read++;
+  }
+  PublishTail();
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::ReleaseHead() {
+  if (peeked_in_use) {
+    metadata[metadata_read % metadata_capacity].state.fetch_and(~Header::IN_USE, std::memory_order::release);
+    peeked_in_use = false;
+  }
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::DropHead() {
+  Header &header = metadata[metadata_read % metadata_capacity];
+  const std::size_t dropped = header.elements;
+  ForwardRead(dropped * GetElementSize());
+  read_elements += dropped;
+  metadata_read++;
+  PublishTail();
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::GenerateConcealment(const std::size_t packets, const ConcealmentRef callback, const std::chrono::nanoseconds now) {
+  // Alter missing to be the smallest of the missing packets or what we can currently fit in the buffer.
+  // Nothing says how long missing packets were, so assume the sender kept the duration of the last one.
+  const std::size_t elements = last_packet_elements;
+  const std::size_t packet_size = elements * GetElementSize();
+  const std::size_t space = FreeBytes(packets * packet_size);
+  const std::size_t full_packets_fit = std::min(space / packet_size, FreeHeaders(packets));
+  const std::size_t to_conceal = std::min(packets, full_packets_fit);
+  const unsigned long last = last_written_sequence_number.value();
+  if (packets != to_conceal) {
+    logger->warning << "Couldn't fit all missing. Asking for: " << to_conceal << "/" << packets << std::flush;
+  }
+  for (std::size_t sequence_offset = 0; sequence_offset < to_conceal; sequence_offset++) {
+    // We need to write the header for this packet.
+    const std::uint32_t sequence_number = static_cast<std::uint32_t>(last + sequence_offset + 1);
+    WriteHeader(metadata_write + sequence_offset, sequence_number, elements, now, true);
+    Index(sequence_number, metadata_write + sequence_offset, write_position + (sequence_offset * packet_size), elements, true);
+    if (lazy_concealment) {
+      // The reader fills it in if it's still missing when reached.
+      metadata[(metadata_write + sequence_offset) % metadata_capacity].state.fetch_or(Header::PLACEHOLDER, std::memory_order::relaxed);
+      continue;
+    }
+    concealment_packets[sequence_offset] = {
+            .sequence_number = sequence_number,
+            .data = buffer + Wrap(write_offset + (sequence_offset * packet_size)),
+            .length = packet_size,
+            .elements = elements,
+    };
+  }
+
+  if (async_concealment) {
+    // Pending until a worker has filled them, which neither side will wait for. Updates may still replace them.
+    OldestPending();
+    for (std::size_t sequence_offset = 0; sequence_offset < to_conceal; sequence_offset++) {
+      const std::size_t packet = metadata_write + sequence_offset;
+      std::atomic<std::uint16_t> &state = metadata[packet % metadata_capacity].state;
+      state.fetch_or(Header::PENDING, std::memory_order::relaxed);
+      concealment_jobs[sequence_offset] = {
+              .packet = concealment_packets[sequence_offset],
+              .callback = &async_concealment,
+              .state = &state,
+              .wanted_flag = Header::CONCEALMENT,
+              .claim_flag = Header::IN_USE,
+              .done_flags = Header::PENDING,
+      };
+      pending_slots[pending_end++ % pending_slots.size()] = {.packet = packet, .position = write_position + (sequence_offset * packet_size)};
+    }
+    concealment_workers->Submit(concealment_worker, std::span<const ConcealmentWorkers::Job>(concealment_jobs.data(), to_conceal));
+  } else if (!lazy_concealment) {
+    callback(std::span<Packet>(concealment_packets.data(), to_conceal));
+  }
+
+  // Now that we've finished providing data, update values for the reader.
+  if (to_conceal > 0) {
+    metadata_write += to_conceal;
+    ForwardWrite(to_conceal * packet_size);
+    write_elements += to_conceal * elements;
+    PublishHead(now);
+  }
+  last_written_sequence_number = last + to_conceal;
+  return elements * to_conceal;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Update(const Packet &packet) {
+  // Look up where this sequence number was written.
+  IndexEntry &entry = index[packet.sequence_number % index.size()];
+  const bool indexed = entry.sequence_number == packet.sequence_number && entry.packet != NO_POSITION;
+  if (indexed && !entry.concealment) {
+    // We already have, or had, real data for this one.
+    logger->warning << "[" << packet.sequence_number << "] Duplicate packet." << std::flush;
+    writer_metrics.Add(DUPLICATE_PACKETS, 1);
+    return 0;
+  }
+
+  if (!indexed || entry.packet < tail.packets.load(std::memory_order::acquire)) {
+    // Never written, overwritten, or already read.
+    logger->warning << "[" << packet.sequence_number << "] Couldn't find target packet." << std::flush;
+    writer_metrics.Add(UPDATE_MISSED_FRAMES, packet.elements);
+    return 0;
+  }
+
+  if (packet.elements != entry.elements) {
+    // Concealment guessed the wrong duration, and swapping in a different one would shift everything after it.
+    logger->warning << "[" << packet.sequence_number << "] Update of " << packet.elements << " elements doesn't match concealed " << entry.elements << std::flush;
+    writer_metrics.Add(UPDATE_MISSED_FRAMES, packet.elements);
+    return 0;
+  }
+
+  Header &header = metadata[entry.packet % metadata_capacity];
+  const std::uint16_t state = header.state.fetch_or(Header::IN_USE, std::memory_order::acquire);
+  if (state & Header::IN_USE) {
+    // It's being read, or a worker is copying in its concealment, we can't update it.
+    logger->warning << "[" << packet.sequence_number << "] Update called on a packet that is currently being "
+                    << (state & Header::PENDING ? "filled by concealment" : "read") << std::flush;
+    writer_metrics.Add(UPDATE_MISSED_FRAMES, packet.elements);
+    return 0;
+  }
+
+  // The reader may have finished with it before we got hold of it.
+  if (entry.packet < tail.packets.load(std::memory_order::acquire)) {
+    header.state.fetch_and(~Header::IN_USE, std::memory_order::release);
+    logger->warning << "[" << packet.sequence_number << "] Couldn't find target packet." << std::flush;
+    writer_metrics.Add(UPDATE_MISSED_FRAMES, packet.elements);
+    return 0;
+  }
+
+  // Copy in the updated data, skipping anything that's already been read.
+  assert(header.sequence_number == packet.sequence_number);
+  const std::size_t remaining = header.elements;
+  const std::size_t read_elements = entry.elements - remaining;
+  const std::size_t source_offset_frames = packet.elements - remaining;
+  std::uint8_t *destination = buffer + Wrap(entry.position + (read_elements * GetElementSize()));
+  memcpy(destination, reinterpret_cast<std::uint8_t *>(packet.data) + (source_offset_frames * GetElementSize()), remaining * GetElementSize());
+  entry.concealment = false;
+  // A worker still synthesizing this finds it's no longer wanted, and clears pending itself once done.
+  header.state.store(state & Header::PENDING, std::memory_order::release);
+  writer_metrics.Add(UPDATED_FRAMES, remaining);
+  return remaining;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Index(const std::uint32_t sequence_number, const std::size_t packet, const std::size_t position, const std::size_t elements, const bool concealment) {
+  IndexEntry &entry = index[sequence_number % index.size()];
+  entry.sequence_number = sequence_number;
+  entry.packet = packet;
+  entry.position = position;
+  entry.elements = elements;
+  entry.concealment = concealment;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::WriteHeader(const std::size_t packet, const std::uint32_t sequence_number, const std::size_t elements, const std::chrono::nanoseconds timestamp, const bool concealment) {
+  Header &header = metadata[packet % metadata_capacity];
+  header.timestamp = timestamp.count();
+  header.sequence_number = sequence_number;
+  header.elements = static_cast<decltype(Header::elements)>(elements);
+  header.state.store(concealment ? Header::CONCEALMENT : 0, std::memory_order::relaxed);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::CopyIntoBuffer(const Packet &packet, const std::chrono::nanoseconds now) {
+  // Ensure we have a header to describe it.
+  if (FreeHeaders(1) == 0) {
+    return 0;
+  }
+  const std::size_t enqueued = CopyIntoBuffer(static_cast<std::uint8_t *>(packet.data), GetElementSize() * packet.elements, true, 0);
+  if (enqueued == 0) {
+    // There was space for 0 frames, so write nothing.
+    return 0;
+  }
+  const std::size_t remainder = enqueued % GetElementSize();
+  const std::size_t enqueued_element_bytes = enqueued - remainder;
+  assert(enqueued_element_bytes % GetElementSize() == 0);// We should write whole elements.
+  return Publish(packet.sequence_number, enqueued_element_bytes / GetElementSize(), false, now);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Publish(const std::uint32_t sequence_number, const std::size_t elements, const bool concealment, const std::chrono::nanoseconds now) {
+  assert(elements > 0);
+  assert(metadata_write - seen_metadata_read < metadata_capacity);
+  WriteHeader(metadata_write, sequence_number, elements, now, concealment);
+  Index(sequence_number, metadata_write, write_position, elements, concealment);
+  metadata_write++;
+  ForwardWrite(elements * GetElementSize());
+  write_elements += elements;
+  PublishHead(now);
+  return elements;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::CopyIntoBuffer(const std::uint8_t *src, const std::size_t length, const bool manual_increment, const std::size_t offset_offset_bytes) {
+  // Ensure we have enough space.
+  const std::size_t space = FreeBytes(length);
+  if (length > space) {
+    logger->error << "No space! Wanted: " << length << " space: " << space << std::flush;
+    return 0;
+  }
+
+  // Copy data into the buffer.
+  const std::size_t offset = Wrap(write_offset + offset_offset_bytes);
+  memcpy(buffer + offset, src, length);
+  if (!manual_increment) ForwardWrite(length);
+  return length;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::uint8_t *BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::GetReadPointerAtPacketOffset(const std::size_t read_offset_packets) const {
+  if (read_offset_packets < metadata_read || read_offset_packets >= head.packets.load(std::memory_order::acquire)) {
+    throw std::runtime_error("Offset must be of a packet held in the buffer");
+  }
+  std::size_t offset = read_offset;
+  for (std::size_t packet = metadata_read; packet < read_offset_packets; packet++) {
+    offset += metadata[packet % metadata_capacity].elements * GetElementSize();
+  }
+  return buffer + Wrap(offset);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::ForwardRead(const std::size_t forward_bytes) {
+  assert(forward_bytes > 0);
+  assert(read_position + forward_bytes <= head.bytes.load(std::memory_order::relaxed));
+  read_offset = Wrap(read_offset + forward_bytes);
+  read_position += forward_bytes;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::ForwardWrite(const std::size_t forward_bytes) {
+  assert(forward_bytes > 0);
+  write_position += forward_bytes;
+  assert(write_position - seen_read_position <= GetCapacity());
+  write_offset = Wrap(write_offset + forward_bytes);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::PublishHead(const std::chrono::nanoseconds now) {
+  // Packets last, so a reader that sees them sees everything written before.
+  head.time.store(now.count(), std::memory_order::relaxed);
+  head.bytes.store(write_position, std::memory_order::relaxed);
+  head.elements.store(write_elements, std::memory_order::relaxed);
+  head.packets.store(metadata_write, std::memory_order::release);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::PublishTail() {
+  // Released, so the writer can't reuse space before the reader has finished with it.
+  tail.elements.store(read_elements, std::memory_order::release);
+  tail.packets.store(metadata_read, std::memory_order::release);
+  tail.bytes.store(read_position, std::memory_order::release);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::FreeBytes(const std::size_t wanted) {
+  std::size_t space = GetCapacity() - (write_position - seen_read_position);
+  if (space < wanted) {
+    seen_read_position = tail.bytes.load(std::memory_order::acquire);
+    if (const PendingSlot *pending = OldestPending()) {
+      seen_read_position = std::min(seen_read_position, pending->position);
+    }
+    space = GetCapacity() - (write_position - seen_read_position);
+  }
+  return space;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::FreeHeaders(const std::size_t wanted) {
+  std::size_t headers = metadata_capacity - (metadata_write - seen_metadata_read);
+  if (headers < wanted) {
+    seen_metadata_read = tail.packets.load(std::memory_order::acquire);
+    if (const PendingSlot *pending = OldestPending()) {
+      seen_metadata_read = std::min(seen_metadata_read, pending->packet);
+    }
+    headers = metadata_capacity - (metadata_write - seen_metadata_read);
+  }
+  return headers;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+const typename BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::PendingSlot *BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::OldestPending() {
+  // A buffer's concealment finishes in order, so the oldest still pending bounds what can be reused, header included.
+  while (pending_begin != pending_end) {
+    const PendingSlot &slot = pending_slots[pending_begin % pending_slots.size()];
+    if (metadata[slot.packet % metadata_capacity].state.load(std::memory_order::acquire) & Header::PENDING) {
+      return &slot;
+    }
+    pending_begin++;
+  }
+  return nullptr;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::size_t BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::HeldElements() const {
+  // Tail first: it never passes head, so this can't go negative.
+  const std::size_t read = tail.elements.load(std::memory_order::acquire);
+  return head.elements.load(std::memory_order::acquire) - read;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::chrono::milliseconds BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::GetCurrentDepth() const {
+  const float ms = HeldElements() * 1000 / clock_rate.count();
+  return std::chrono::milliseconds(static_cast<std::int64_t>(ms));
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::EnableAdaptiveDepth(const std::chrono::milliseconds floor, const float quantile) {
+  if (floor > max_length) {
+    throw std::invalid_argument("Adaptive depth floor cannot be greater than the maximum length.");
+  }
+  const std::chrono::nanoseconds packet_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds(GetPacketElements())) / clock_rate.count();
+  estimator.emplace(packet_duration, max_length, quantile);
+  adaptive_floor = floor;
+  target_depth = floor;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::EnableMultipleProducers() {
+  multiple_producers = true;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::EnableNotifications() {
+  if (!notifications) {
+    notification_fd = std::make_unique<NotificationFd>();
+    notifications = true;
+  }
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+bool BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::WaitForElements(const std::size_t elements, const std::chrono::nanoseconds timeout) {
+  if (!notifications) {
+    throw std::runtime_error("Notifications must be enabled to wait");
+  }
+  const auto ready = [this, elements]() {
+    return play && HeldElements() >= elements;
+  };
+  if (ready()) {
+    return true;
+  }
+
+  // Holding the lock from arming to sleeping means a writer can't wake us in between, and be missed.
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::unique_lock<std::mutex> lock(notify_mutex);
+  while (true) {
+    Arm();
+    if (ready()) {
+      return true;
+    }
+    if (notify_condition.wait_until(lock, deadline) == std::cv_status::timeout) {
+      return ready();
+    }
+  }
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+int BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::GetNotificationFd() {
+  if (!notifications) {
+    throw std::runtime_error("Notifications must be enabled to get a file descriptor");
+  }
+  Arm();
+  return notification_fd->Get();
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::AcknowledgeNotification() {
+  if (!notifications) {
+    throw std::runtime_error("Notifications must be enabled to acknowledge them");
+  }
+  notification_fd->Clear();
+  Arm();
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Arm() {
+  // Pairs with the fence in Notify: either the writer sees the notification armed, or the reader sees its write.
+  notify_armed.store(true, std::memory_order::relaxed);
+  std::atomic_thread_fence(std::memory_order::seq_cst);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Notify() {
+  if (!notifications) {
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order::seq_cst);
+  if (!notify_armed.load(std::memory_order::relaxed) || !notify_armed.exchange(false, std::memory_order::acq_rel)) {
+    return;
+  }
+  {
+    const std::lock_guard<std::mutex> lock(notify_mutex);
+  }
+  notify_condition.notify_all();
+  notification_fd->Signal();
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::Arrived(const std::uint32_t sequence_number, const std::size_t elements, const std::chrono::nanoseconds now) {
+  // Work out where this packet starts in media time. Durations vary, so count forward from the newest packet,
+  // assuming any in between were as long as this one.
+  std::int64_t start;
+  const auto duration = static_cast<std::int64_t>(elements);
+  if (!newest_arrival.has_value()) {
+    start = 0;
+  } else if (sequence_number > newest_arrival.value()) {
+    start = newest_arrival_end + (static_cast<std::int64_t>(sequence_number - newest_arrival.value() - 1) * duration);
+  } else {
+    start = newest_arrival_start - (static_cast<std::int64_t>(newest_arrival.value() - sequence_number) * duration);
+  }
+  if (!newest_arrival.has_value() || sequence_number > newest_arrival.value()) {
+    newest_arrival = sequence_number;
+    newest_arrival_start = start;
+    newest_arrival_end = start + duration;
+  }
+
+  // Jitter is how much the gap between arrivals differs from the gap in media time.
+  if (last_arrival_time.has_value()) {
+    const std::int64_t media_gap = std::chrono::duration_cast<std::chrono::microseconds>(MediaTime(start - last_arrival_start)).count();
+    const std::int64_t arrival_gap = std::chrono::duration_cast<std::chrono::microseconds>(now - last_arrival_time.value()).count();
+    histograms.arrival_jitter.Record(static_cast<std::uint64_t>(std::abs(arrival_gap - media_gap)));
+  }
+  last_arrival_time = now;
+  last_arrival_start = start;
+
+  if (!estimator.has_value()) {
+    return;
+  }
+
+  // Hold enough to cover the expected delay, plus the packet being played out.
+  estimator->Arrival(MediaTime(start), now);
+  const std::chrono::milliseconds packet_duration = std::chrono::milliseconds(elements * 1000 / clock_rate.count());
+  target_depth = std::clamp(estimator->GetDelay() + packet_duration, adaptive_floor, max_length);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::chrono::nanoseconds BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::MediaTime(const std::int64_t elements) const {
+  // Whole seconds first, so long calls and big sequence jumps don't overflow multiplying out to nanoseconds.
+  const auto rate = static_cast<std::int64_t>(clock_rate.count());
+  return std::chrono::nanoseconds(((elements / rate) * 1000000000) + ((elements % rate) * 1000000000 / rate));
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+std::chrono::milliseconds BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::GetTargetDepth() const {
+  return target_depth;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::EnableTimeStretch(const TimeStretchCallback &callback, const std::size_t lookahead) {
+  if (!callback) {
+    throw std::invalid_argument("Time stretch callback must be set.");
+  }
+  time_stretch = callback;
+  stretch_lookahead = lookahead;
+  stretch_buffer.resize(((2 * GetPacketElements()) + lookahead) * GetElementSize());
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::EnableLazyConcealment(const DeferredConcealmentCallback &callback) {
+  if (!callback) {
+    throw std::invalid_argument("Lazy concealment needs a callback");
+  }
+  if (async_concealment) {
+    throw std::runtime_error("Lazy concealment can't be combined with async concealment");
+  }
+  lazy_concealment = callback;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::EnableAsyncConcealment(const DeferredConcealmentCallback &callback, const std::shared_ptr<ConcealmentWorkers> &workers) {
+  if (!callback || !workers) {
+    throw std::invalid_argument("Async concealment needs a callback and workers");
+  }
+  if (lazy_concealment) {
+    throw std::runtime_error("Async concealment can't be combined with lazy concealment");
+  }
+  async_concealment = callback;
+  concealment_workers = workers;
+  concealment_worker = workers->Assign();
+
+  // There can't be more pending than there are headers.
+  concealment_jobs = std::vector<ConcealmentWorkers::Job>(metadata_capacity);
+  pending_slots = std::vector<PendingSlot>(metadata_capacity);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+void BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::EnableDriftCompensation(const SampleFormat &format, const std::chrono::seconds time_constant) {
+  if (format.layout != SampleLayout::Interleaved || format.GetElementSize() != GetElementSize()) {
+    std::ostringstream message;
+    message << "Drift compensation format must be interleaved, with elements of " << GetElementSize() << " bytes. Got: " << format.GetElementSize();
+    throw std::invalid_argument(message.str());
+  }
+  drift_estimator.emplace(time_constant);
+  drift_format = format;
+
+  // Start with a silent element before the first position, for the interpolator to look back on.
+  resample_buffer.assign((2 * GetPacketElements()) * GetElementSize(), 0);
+  resample_elements = 1;
+  resample_position = 1;
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+double BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::GetClockDrift() const {
+  return clock_drift.load(std::memory_order::relaxed);
+}
+
+template<std::size_t ElementSizeBytes, std::size_t PacketElementCount, std::size_t CapacityBytes>
+Metrics BasicJitterBuffer<ElementSizeBytes, PacketElementCount, CapacityBytes>::GetMetrics() const {
+  // Each side's counters are consistent with themselves, though not necessarily with the other side's.
+  const auto writer = writer_metrics.Snapshot();
+  const auto reader = reader_metrics.Snapshot();
+  return Metrics{
+          .concealed_frames = writer[CONCEALED_FRAMES],
+          .skipped_frames = reader[SKIPPED_FRAMES],
+          .filled_packets = writer[FILLED_PACKETS],
+          .updated_frames = writer[UPDATED_FRAMES],
+          .update_missed_frames = writer[UPDATE_MISSED_FRAMES],
+          .accelerated_elements = reader[ACCELERATED_ELEMENTS],
+          .decelerated_elements = reader[DECELERATED_ELEMENTS],
+          .enqueued_elements = writer[ENQUEUED_ELEMENTS],
+          .dequeued_elements = reader[DEQUEUED_ELEMENTS],
+          .dropped_packets = writer[DROPPED_PACKETS],
+          .duplicate_packets = writer[DUPLICATE_PACKETS],
+  };
+}
+
+extern template class BasicJitterBuffer<>;
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "JitterBuffer.hh"
+
+#include <cantina/logger.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Owns many jitter buffers, one per stream, sharded across a fixed set of worker threads.
+ *
+ * Each stream belongs to a single shard, whose worker is both the writer and reader of its buffer. Packets may be
+ * enqueued from any thread. They are copied into the shard's lock-free ingress queue, and the worker applies them in
+ * batches.
+ * DequeueAll has every worker dequeue all of its streams in parallel, once per tick. Buffers share one RingArena.
+ */
+class JitterBufferPool {
+  public:
+  typedef std::uint32_t StreamId;
+
+  /// @brief Calls to Enqueue each shard can hold before its worker applies them.
+  constexpr static std::size_t INGRESS_SLOTS = 256;
+
+  /// @brief Generates concealment for a stream's missing packets. Called on the stream's worker thread.
+  typedef std::function<void(StreamId stream, std::span<Packet> packets)> ConcealmentCallback;
+
+  /// @brief Elements dequeued for a stream this tick.
+  struct Dequeued {
+    StreamId stream;
+    /// @brief The elements. Valid until the next DequeueAll, or the stream is removed.
+    const std::uint8_t *data;
+    std::size_t elements;
+  };
+
+  /**
+   * @brief Construct a new Jitter Buffer Pool and start its workers.
+   *
+   * @param shards Number of worker threads. Zero uses one per hardware thread.
+   * @param concealment_callback Fired when concealment data needs to be generated for a stream.
+   * @param logger Pointer to external parent logger.
+   * @param pin True to pin each worker to its own core, where supported.
+   * @param huge_pages True to back streams' rings of at least a huge page with huge pages, where available. See
+   * RingArena.
+   */
+  JitterBufferPool(std::size_t shards, const ConcealmentCallback &concealment_callback, const cantina::LoggerPointer &logger, bool pin = true, bool huge_pages = false);
+
+  /**
+   * @brief Stop the workers and destroy all streams.
+   */
+  ~JitterBufferPool();
+
+  JitterBufferPool(const JitterBufferPool &) = delete;
+  JitterBufferPool &operator=(const JitterBufferPool &) = delete;
+
+  /**
+   * @brief Add a stream, with a buffer constructed as for JitterBuffer.
+   *
+   * @param element_size Size of held elements in bytes.
+   * @param packet_elements Nominal number of elements in packets.
+   * @param clock_rate Clock rate of elements contained in Hz. E.g 48kHz audio is 48000.
+   * @param max_length The maximum length of the buffer.
+   * @param min_length The minimum depth before playing.
+   * @returns The new stream's identifier.
+   */
+  StreamId AddStream(std::size_t element_size,
+                     std::size_t packet_elements,
+                     std::uint32_t clock_rate,
+                     std::chrono::milliseconds max_length,
+                     std::chrono::milliseconds min_length);
+
+  /**
+   * @brief Remove a stream. Packets still queued for it are dropped.
+   *
+   * @param stream The stream to remove.
+   */
+  void RemoveStream(StreamId stream);
+
+  /**
+   * @brief Queue packets for a stream. This may be called from any thread, and copies the packets' data. It takes no
+   * locks unless the stream's worker is asleep, and only waits if INGRESS_SLOTS calls are already queued for its shard.
+   *
+   * @param stream The stream the packets belong to.
+   * @param packets The packets.
+   * @param count The number of packets.
+   */
+  void Enqueue(StreamId stream, const Packet *packets, std::size_t count);
+
+  /**
+   * @brief Dequeue from every stream in parallel, after applying anything already queued.
+   * Streams with nothing to play are left out. This must be called from a single thread.
+   *
+   * @param elements The number of elements to dequeue from each stream.
+   * @returns What was dequeued, valid until the next call.
+   */
+  const std::vector<Dequeued> &DequeueAll(std::size_t elements);
+
+  /**
+   * @param stream The stream.
+   * @returns A snapshot of the stream's metrics.
+   */
+  Metrics GetMetrics(StreamId stream) const;
+
+  private:
+  /// @brief A packet waiting in a shard's ingress queue. Its data is at offset in the slot's bytes.
+  struct Ingress {
+    unsigned long sequence_number;
+    std::size_t elements;
+    std::size_t offset;
+    std::size_t length;
+  };
+
+  /// @brief One call to Enqueue, and the bytes its packets refer to. Reused, keeping its capacity, once applied.
+  struct alignas(JitterBuffer::CACHE_LINE_SIZE) Slot {
+    /// @brief The queue position this slot is free for, or one past it once filled.
+    std::atomic<std::size_t> sequence;
+    StreamId stream;
+    std::vector<Ingress> packets;
+    std::vector<std::uint8_t> bytes;
+  };
+
+  struct Stream {
+    std::unique_ptr<JitterBuffer> buffer;
+    std::vector<std::uint8_t> output;
+  };
+
+  struct Shard {
+    std::thread worker;
+
+    // A bounded queue after Vyukov's: producers claim a position with a compare and swap, then fill and publish its
+    // slot without locking, and the worker applies filled slots in order. The mutex only guards sleeping, so producers
+    // take it just to wake a worker that ran out of work.
+    std::unique_ptr<Slot[]> slots;
+    alignas(JitterBuffer::CACHE_LINE_SIZE) std::atomic<std::size_t> enqueue_position{0};
+    alignas(JitterBuffer::CACHE_LINE_SIZE) std::size_t dequeue_position = 0;
+    std::atomic<bool> sleeping{false};
+    std::mutex wake_mutex;
+
+    // Streams are guarded by their own lock, only contended when streams are added, removed or read. Producers never
+    // take it.
+    mutable std::mutex streams_mutex;
+    std::unordered_map<StreamId, Stream> streams;
+    std::vector<Packet> run;
+    std::vector<Dequeued> dequeued;
+
+    std::condition_variable wake;
+    bool stop = false;
+    std::size_t tick_elements = 0;
+    bool tick = false;
+  };
+
+  cantina::LoggerPointer logger;
+  ConcealmentCallback concealment_callback;
+  // Streams come and go, so their rings are recycled rather than mapped afresh.
+  std::shared_ptr<RingArena> arena;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<StreamId> next_stream;
+  std::mutex done_mutex;
+  std::condition_variable done;
+  std::size_t ticks_outstanding;
+  std::vector<Dequeued> dequeued;
+
+  Shard &ShardFor(StreamId stream) const;
+  void Work(Shard &shard);
+  void Apply(Shard &shard);
+  void Tick(Shard &shard, std::size_t elements);
+  static void Pin(std::thread &thread, std::size_t core);
+};
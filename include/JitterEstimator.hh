@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief Estimates packet arrival jitter and how much buffering is needed to absorb it.
+ *
+ * Tracks RFC 3550 style interarrival jitter, and a histogram of each packet's delay relative to the fastest
+ * recently seen packet. Older samples are gradually forgotten, and a high quantile of the histogram gives the
+ * delay needed to play out that proportion of packets on time.
+ */
+class JitterEstimator {
+  public:
+  /**
+   * @brief Construct a new Jitter Estimator.
+   *
+   * @param packet_duration The media duration of each packet.
+   * @param max_delay The largest delay to track. Larger delays are counted as this.
+   * @param quantile The proportion of packets the estimated delay should cover, between 0 and 1.
+   */
+  JitterEstimator(std::chrono::nanoseconds packet_duration, std::chrono::milliseconds max_delay, float quantile);
+
+  /**
+   * @brief Record the arrival of a packet.
+   *
+   * @param sequence_number The sequence number of the arriving packet.
+   * @param now The time it arrived.
+   */
+  void Arrival(std::uint32_t sequence_number, std::chrono::nanoseconds now);
+
+  /**
+   * @brief Record the arrival of a packet, for when packet durations vary.
+   *
+   * @param media_time When the packet starts, in media time since the first packet.
+   * @param now The time it arrived.
+   */
+  void Arrival(std::chrono::nanoseconds media_time, std::chrono::nanoseconds now);
+
+  /**
+   * @return The smoothed RFC 3550 interarrival jitter.
+   */
+  std::chrono::nanoseconds GetJitter() const;
+
+  /**
+   * @return The delay covering the configured quantile of recent packets.
+   */
+  std::chrono::milliseconds GetDelay() const;
+
+  private:
+  /// @brief Arrivals per window of the sliding minimum transit time.
+  const static std::size_t WINDOW_PACKETS = 256;
+  /// @brief Weight retained by existing samples on each arrival.
+  constexpr static double FORGET_FACTOR = 0.998;
+
+  std::chrono::nanoseconds packet_duration;
+  float quantile;
+
+  std::optional<std::int64_t> last_transit;
+  double jitter;
+
+  std::int64_t current_minimum;
+  std::int64_t previous_minimum;
+  std::size_t window_arrivals;
+
+  std::vector<double> histogram;
+  double weight;
+  double total_weight;
+  // The bucket holding the quantile, and the weight of every bucket before it.
+  std::size_t quantile_index;
+  double below_quantile;
+  std::chrono::milliseconds delay;
+};
@@ -13,6 +13,18 @@ struct Metrics {
   unsigned long updated_frames;
   /// @brief Number of real frames that arrived too late to be used to update concealment data.
   unsigned long update_missed_frames;
+  /// @brief Number of elements removed by time stretching to reduce depth.
+  unsigned long accelerated_elements;
+  /// @brief Number of elements added by time stretching to grow depth.
+  unsigned long decelerated_elements;
+  /// @brief Number of elements of real data written to the buffer.
+  unsigned long enqueued_elements;
+  /// @brief Number of elements read out of the buffer, real or concealed.
+  unsigned long dequeued_elements;
+  /// @brief Number of packets dropped because the buffer was full.
+  unsigned long dropped_packets;
+  /// @brief Number of packets that arrived after real data for them was already held, or played.
+  unsigned long duplicate_packets;
 };
 
 #endif
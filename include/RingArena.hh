@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/// @brief Pages backing a ring.
+enum class RingBacking : std::uint8_t {
+  /// @brief Base pages.
+  Standard,
+  /// @brief Shared memory advised to use transparent huge pages. The kernel may still fall back to base pages.
+  TransparentHuge,
+  /// @brief Reserved 2 MiB huge pages.
+  Huge,
+};
+
+/// @brief A mirrored ring: length bytes, mapped twice back to back.
+struct Ring {
+  std::uint8_t *address;
+  std::size_t length;
+  RingBacking backing;
+};
+
+/**
+ * @brief Hands out mirrored rings carved from a few large shared memory regions, instead of a file and mappings
+ * per ring. Released rings are kept mapped and handed out again to the next request of the same size, so once
+ * warmed up, allocating a ring makes no system calls. Everything is unmapped when the arena is destroyed.
+ * This is thread safe.
+ */
+class RingArena {
+  public:
+  /// @brief Default size of each shared memory region.
+  constexpr static std::size_t DEFAULT_REGION_SIZE = 64 * 1024 * 1024;
+  /// @brief Size of the huge pages used when asked for.
+  constexpr static std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+  /**
+   * @brief Construct a new Ring Arena.
+   *
+   * @param region_size Size of each shared memory region. Larger rings get a region of their own.
+   * @param huge_pages True to back rings of at least a huge page with huge pages, cutting TLB misses when many rings
+   * are in use. Those rings are rounded up to whole huge pages. Reserved huge pages are used when available, then
+   * transparent huge pages, then base pages. See GetBacking. Smaller rings always use base pages: each half of a
+   * mirrored ring must start on a page boundary, so a huge page can't be shared between rings, and rounding up would
+   * waste most of it.
+   */
+  explicit RingArena(std::size_t region_size = DEFAULT_REGION_SIZE, bool huge_pages = false);
+
+  /**
+   * @brief Unmap every ring and region. All rings must have been released.
+   */
+  ~RingArena();
+
+  RingArena(const RingArena &) = delete;
+  RingArena &operator=(const RingArena &) = delete;
+
+  /**
+   * @brief Get a ring, mapped twice back to back so accesses running off the end wrap to the start.
+   *
+   * @param length Wanted length in bytes, rounded up to a whole number of pages.
+   * @return The ring, with its rounded length and backing.
+   */
+  [[nodiscard]] Ring Allocate(std::size_t length);
+
+  /**
+   * @brief Return a ring for reuse.
+   *
+   * @param ring Ring returned from Allocate.
+   */
+  void Release(const Ring &ring);
+
+  /**
+   * @return Backing of newly mapped rings of at least a huge page. Only ever falls back from what was asked for.
+   */
+  RingBacking GetBacking() const;
+
+  /**
+   * @return Number of shared memory regions, and so file descriptors, in use.
+   */
+  std::size_t GetRegions() const;
+
+  /**
+   * @return Number of released rings waiting to be reused.
+   */
+  std::size_t GetFreeRings() const;
+
+  private:
+  struct Region {
+    int fd;
+    std::size_t size;
+    std::size_t used;
+    RingBacking backing;
+  };
+
+  struct Mapping {
+    std::uint8_t *address;
+    std::size_t length;
+  };
+
+  std::size_t region_size;
+  RingBacking backing;
+  mutable std::mutex mutex;
+  std::vector<Region> regions;
+  std::vector<Mapping> mappings;
+  std::unordered_map<std::size_t, std::vector<Ring>> free_rings;
+
+  RingBacking BackingFor(std::size_t length) const;
+  static std::size_t Granularity(RingBacking ring_backing);
+  Ring Map(std::size_t length, RingBacking wanted);
+  Region &RegionFor(std::size_t length, RingBacking wanted);
+};
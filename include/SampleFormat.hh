@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// @brief Encoding of a single PCM sample.
+enum class SampleType : std::uint8_t {
+  /// @brief Signed 16 bit, native endian.
+  Int16,
+  /// @brief Signed 24 bit, packed into 3 little endian bytes.
+  Int24,
+  /// @brief 32 bit float, nominally between -1 and 1.
+  Float32,
+};
+
+/// @brief Arrangement of channels in memory.
+enum class SampleLayout : std::uint8_t {
+  /// @brief Each element's channels side by side.
+  Interleaved,
+  /// @brief Each channel in a block of its own, one after another.
+  Planar,
+};
+
+/// @brief Describes PCM audio in memory.
+struct SampleFormat {
+  SampleType type;
+  SampleLayout layout;
+  std::size_t channels;
+
+  /**
+   * @returns Size of a single sample in bytes.
+   */
+  std::size_t GetSampleSize() const;
+
+  /**
+   * @returns Size of an element, one sample from every channel, in bytes.
+   */
+  std::size_t GetElementSize() const;
+};
+
+/**
+ * @brief Convert PCM between formats in a single pass, touching each sample once. Integer samples are scaled to and
+ * from floats between -1 and 1, out of range floats clip, and channels are interleaved or deinterleaved as needed.
+ * Inner loops run over one channel at a time, at compile time strides for the common cases.
+ *
+ * @param source The samples to convert.
+ * @param source_format Format of source.
+ * @param source_plane_elements For a planar source, elements between the start of each channel. Otherwise ignored.
+ * @param destination Where to write the converted samples.
+ * @param destination_format Format of destination. Must have as many channels as the source.
+ * @param destination_plane_elements For a planar destination, elements between the start of each channel. Otherwise
+ * ignored.
+ * @param elements The number of elements to convert.
+ */
+void ConvertSamples(const std::uint8_t *source, const SampleFormat &source_format, std::size_t source_plane_elements,
+                    std::uint8_t *destination, const SampleFormat &destination_format, std::size_t destination_plane_elements,
+                    std::size_t elements);
+
+/**
+ * @brief Add scaled samples into destination. Int16 sums saturate, float sums don't clip.
+ *
+ * @param source The samples to add.
+ * @param type Type of both source and destination samples. Int16 or Float32.
+ * @param gain Linear gain applied to each source sample.
+ * @param destination The samples to add to.
+ * @param samples The number of samples.
+ */
+void MixSamples(const std::uint8_t *source, SampleType type, float gain, std::uint8_t *destination, std::size_t samples);
+
+/**
+ * @brief Resample interleaved PCM at a fractional rate, with 4 point cubic Hermite interpolation.
+ *
+ * @param source Interleaved samples. Each output reads the element either side of its position, and one beyond
+ * each of those, so source must hold elements from floor(position) - 1 to floor(last position) + 2.
+ * @param format Format of source and destination. Must be interleaved.
+ * @param position Position of the first output, in source elements.
+ * @param step Source elements advanced per output element.
+ * @param destination Where to write the resampled elements.
+ * @param elements The number of elements to produce.
+ */
+void InterpolateSamples(const std::uint8_t *source, const SampleFormat &format, double position, double step, std::uint8_t *destination, std::size_t elements);
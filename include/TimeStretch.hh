@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief WSOLA style time stretching of interleaved PCM, usable as a JitterBuffer::TimeStretchCallback.
+ *
+ * Each call removes or repeats a single pitch period. The period is chosen by normalized cross correlation,
+ * and the splice is crossfaded. Blocks that aren't periodic enough to splice cleanly are passed through as is.
+ *
+ * @tparam Sample The sample type, std::int16_t or float.
+ */
+template<typename Sample>
+class Wsola {
+  public:
+  /**
+   * @brief Construct a new Wsola time stretcher.
+   *
+   * @param channels Number of interleaved channels in each element.
+   * @param clock_rate Clock rate of elements in Hz.
+   */
+  Wsola(std::size_t channels, std::uint32_t clock_rate);
+
+  /**
+   * @brief Stretch source into exactly destination_elements of output.
+   * If source_elements is greater than destination_elements, up to one pitch period more than is produced
+   * is consumed. Otherwise, up to one pitch period less is consumed.
+   *
+   * @returns The number of source elements consumed.
+   */
+  std::size_t operator()(const std::uint8_t *source, std::size_t source_elements, std::uint8_t *destination, std::size_t destination_elements) const;
+
+  /**
+   * @return The most elements beyond those produced that can be consumed in one call.
+   */
+  std::size_t GetLookahead() const;
+
+  private:
+  /// @brief Lowest normalized correlation considered periodic enough to splice.
+  constexpr static double MIN_CORRELATION = 0.5;
+  /// @brief Candidate periods are searched at this stride, then refined.
+  const static std::size_t SEARCH_STEP = 4;
+
+  std::size_t channels;
+  std::size_t min_period;
+  std::size_t max_period;
+  std::size_t overlap;
+
+  std::size_t FindPeriod(const Sample *source, std::size_t first, std::size_t last, std::size_t length, double &correlation) const;
+  double Correlation(const Sample *a, const Sample *b, std::size_t elements) const;
+  void Crossfade(const Sample *out, const Sample *in, Sample *destination, std::size_t elements) const;
+};
+
+extern template class Wsola<std::int16_t>;
+extern template class Wsola<float>;
@@ -2,6 +2,7 @@
 #define LIBJITTER_LIBJITTER_H
 
 #include "Packet.h"
+#include "Metrics.h"
 
 #include <cantina/logger.h>
 
@@ -13,6 +14,18 @@ extern "C" {
 
 typedef void (*LibJitterConcealmentCallback)(struct Packet *, const size_t num_packets, void *user_data);
 
+/// @brief A read-only view of contiguous elements held in the buffer.
+struct JitterReadView {
+  /// @brief Pointer to the first element. Valid until the view is committed.
+  const void *data;
+  /// @brief Number of elements available at data.
+  size_t elements;
+  /// @brief Sequence number of the packet these elements belong to.
+  unsigned long sequence_number;
+  /// @brief Non-zero if these elements were generated by concealment.
+  int concealment;
+};
+
 /**
    * @brief Construct a new Jitter Buffer object.
    *
@@ -21,6 +34,7 @@ typedef void (*LibJitterConcealmentCallback)(struct Packet *, const size_t num_p
    * @param max_length The maximum length of the buffer in milliseconds.
    * @param mix_length The minimum age of packets in milliseconds before eligible for dequeue.
    * @param logger Pointer to external parent logger.
+   * @return The jitter buffer instance, or NULL if the parameters are invalid.
    */
 void *JitterInit(size_t element_size, size_t packet_elements, unsigned long clock_rate, unsigned long max_length_ms, unsigned long min_length_ms, cantina::Logger *logger);
 
@@ -49,6 +63,98 @@ size_t JitterEnqueue(void *libjitter, const struct Packet packets[], size_t elem
 /// @return Number of elements each of length element_size bytes actually dequeued.
 size_t JitterDequeue(void *libjitter, void *destination, size_t destination_length, size_t elements);
 
+/// @brief Reserve space for the next packet so it can be written in place, avoiding a copy.
+/// @param libjitter The jitter buffer instance.
+/// @param sequence_number The sequence number of the packet to be written.
+/// @param elements The number of elements to be written.
+/// @return Pointer to write the packet's elements to, or NULL if the packet can't be written in place.
+void *JitterReserveWrite(void *libjitter, unsigned long sequence_number, size_t elements);
+
+/// @brief Publish the packet written to the last JitterReserveWrite.
+/// @param libjitter The jitter buffer instance.
+/// @param concealment_callback Fired when concealment data needs to be generated.
+/// @param user_data User data pointer passed to concealment_callback.
+/// @return Number of elements enqueued, including concealment.
+size_t JitterCommitWrite(void *libjitter, LibJitterConcealmentCallback concealment_callback, void *user_data);
+
+/// @brief Get a view of the next available elements in place, without copying them out of the buffer.
+/// @param libjitter The jitter buffer instance.
+/// @param elements The maximum number of elements wanted.
+/// @param view Filled with the view, if one is available.
+/// @return Non-zero if a view is available.
+int JitterPeekRead(void *libjitter, size_t elements, struct JitterReadView *view);
+
+/// @brief Consume elements from the view returned by the last JitterPeekRead, invalidating it.
+/// @param libjitter The jitter buffer instance.
+/// @param elements The number of elements consumed. Zero releases the view without consuming anything, and does
+/// nothing if no view is held. Non-zero without a view consumes nothing.
+void JitterCommitRead(void *libjitter, size_t elements);
+
+/// @brief Allow the writer functions to be called from several threads at once. Call before any are.
+/// @param libjitter The jitter buffer instance.
+void JitterEnableMultipleProducers(void *libjitter);
+
+/// @brief Allow the reader to sleep until data arrives. Must be called before the writer starts.
+/// @param libjitter The jitter buffer instance.
+void JitterEnableNotifications(void *libjitter);
+
+/// @brief Only conceal missing packets when a read reaches them, instead of as soon as they're missed. Must be called
+/// before the writer starts.
+/// @param libjitter The jitter buffer instance.
+/// @param concealment_callback Fills in missing packets, on the reader thread. The per call callbacks are then unused.
+/// Must not be NULL.
+/// @param user_data Passed to the callback.
+void JitterEnableLazyConcealment(void *libjitter, LibJitterConcealmentCallback concealment_callback, void *user_data);
+
+/// @brief Start threads to synthesize concealment on, which may be shared by many buffers.
+/// @param workers Number of worker threads. Zero uses one per hardware thread.
+/// @param logger Pointer to external parent logger.
+/// @return The workers, or NULL if they couldn't be started.
+void *JitterConcealmentWorkersInit(size_t workers, cantina::Logger *logger);
+
+/// @brief Wait until every concealment already handed to the workers has been synthesized.
+/// @param workers The workers.
+void JitterConcealmentWorkersDrain(void *workers);
+
+/// @brief Release the workers. Buffers using them keep them running until they are destroyed too.
+/// @param workers The workers.
+void JitterConcealmentWorkersDestroy(void *workers);
+
+/// @brief Conceal missing packets on a worker thread, so the writer never waits on it. Must be called before the writer
+/// starts.
+/// @param libjitter The jitter buffer instance.
+/// @param workers Workers from JitterConcealmentWorkersInit.
+/// @param concealment_callback Fills in missing packets, on the worker. The per call callbacks are then unused.
+/// Must not be NULL.
+/// @param user_data Passed to the callback.
+void JitterEnableAsyncConcealment(void *libjitter, void *workers, LibJitterConcealmentCallback concealment_callback, void *user_data);
+
+/// @brief Wait until at least the given number of elements can be dequeued, or the timeout passes.
+/// @param libjitter The jitter buffer instance.
+/// @param elements The number of elements wanted.
+/// @param timeout_ms The longest to wait, in milliseconds.
+/// @return 1 if the elements are available, 0 if the wait timed out, -1 if notifications aren't enabled.
+int JitterWaitForElements(void *libjitter, size_t elements, unsigned long timeout_ms);
+
+/// @brief Get a file descriptor that becomes readable when data is written, to poll on.
+/// @param libjitter The jitter buffer instance.
+/// @return The file descriptor, owned by the buffer, or -1 if notifications aren't enabled.
+int JitterGetNotificationFd(void *libjitter);
+
+/// @brief Make the notification file descriptor unreadable, and arm it for the next write.
+/// @param libjitter The jitter buffer instance.
+void JitterAcknowledgeNotification(void *libjitter);
+
+/// @brief Get the current depth of the buffer.
+/// @param libjitter The jitter buffer instance.
+/// @return Current depth in milliseconds.
+unsigned long JitterGetCurrentDepth(void *libjitter);
+
+/// @brief Get a snapshot of the buffer's metrics.
+/// @param libjitter The jitter buffer instance.
+/// @return The current metrics.
+struct Metrics JitterGetMetrics(void *libjitter);
+
 /// @brief Destroy a libjitter instance.
 /// @param libjitter The jitter buffer instance to destroy.
 void JitterDestroy(void *libjitter);
@@ -3,6 +3,15 @@
 
 #include <iostream>
 
+namespace {
+  /// @brief Forwards the buffer's concealment packets to a C callback, without allocating.
+  auto Trampoline(const LibJitterConcealmentCallback concealment_callback, void *user_data) {
+    return [concealment_callback, user_data](const std::span<Packet> packets) {
+      concealment_callback(packets.data(), packets.size(), user_data);
+    };
+  }
+}
+
 extern "C" {
 void *JitterInit(const size_t element_size,
                  const size_t packet_elements,
@@ -10,12 +19,17 @@ void *JitterInit(const size_t element_size,
                  const unsigned long max_length_ms,
                  const unsigned long min_length_ms,
                  cantina::Logger *logger) {
-  return new JitterBuffer(element_size,
-                          packet_elements,
-                          std::uint32_t(clock_rate),
-                          std::chrono::milliseconds(max_length_ms),
-                          std::chrono::milliseconds(min_length_ms),
-                          cantina::LoggerPointer(logger));
+  try {
+    return new JitterBuffer(element_size,
+                            packet_elements,
+                            std::uint32_t(clock_rate),
+                            std::chrono::milliseconds(max_length_ms),
+                            std::chrono::milliseconds(min_length_ms),
+                            cantina::LoggerPointer(logger));
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return nullptr;
+  }
 }
 
 size_t JitterPrepare(void *libjitter,
@@ -23,11 +37,8 @@ size_t JitterPrepare(void *libjitter,
                      const LibJitterConcealmentCallback concealment_callback,
                      void *user_data) {
   auto *buffer = static_cast<JitterBuffer *>(libjitter);
-  JitterBuffer::ConcealmentCallback callback = [concealment_callback, user_data](std::vector<Packet> &packets) {
-    concealment_callback(&packets[0], packets.capacity(), user_data);
-  };
   try {
-    return buffer->Prepare(sequence_number, callback);
+    return buffer->Prepare(sequence_number, Trampoline(concealment_callback, user_data));
   } catch (const std::exception &ex) {
     std::cerr << ex.what() << std::endl;
     return 0;
@@ -40,14 +51,8 @@ size_t JitterEnqueue(void *libjitter,
                      const LibJitterConcealmentCallback concealment_callback,
                      void *user_data) {
   auto *buffer = static_cast<JitterBuffer *>(libjitter);
-
-  JitterBuffer::ConcealmentCallback callback = [concealment_callback, user_data](std::vector<Packet> &packets) {
-    concealment_callback(&packets[0], packets.capacity(), user_data);
-  };
-
-  const std::vector<Packet> vector(packets, packets + elements);
   try {
-    return buffer->Enqueue(vector, callback);
+    return buffer->Enqueue(packets, elements, Trampoline(concealment_callback, user_data));
   } catch (const std::exception &ex) {
     std::cerr << ex.what() << std::endl;
     return 0;
@@ -67,6 +72,146 @@ size_t JitterDequeue(void *libjitter,
   }
 }
 
+void *JitterReserveWrite(void *libjitter,
+                         const unsigned long sequence_number,
+                         const size_t elements) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    return buffer->ReserveWrite(std::uint32_t(sequence_number), elements);
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return nullptr;
+  }
+}
+
+size_t JitterCommitWrite(void *libjitter,
+                         const LibJitterConcealmentCallback concealment_callback,
+                         void *user_data) {
+  auto *buffer = static_cast<JitterBuffer *>(libjitter);
+  try {
+    return buffer->CommitWrite(Trampoline(concealment_callback, user_data));
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 0;
+  }
+}
+
+int JitterPeekRead(void *libjitter,
+                   const size_t elements,
+                   JitterReadView *view) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    const std::optional<ReadView> peeked = buffer->PeekRead(elements);
+    if (!peeked.has_value()) {
+      return 0;
+    }
+    view->data = peeked->data;
+    view->elements = peeked->elements;
+    view->sequence_number = peeked->sequence_number;
+    view->concealment = peeked->concealment;
+    return 1;
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return 0;
+  }
+}
+
+void JitterCommitRead(void *libjitter,
+                      const size_t elements) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    buffer->CommitRead(elements);
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+  }
+}
+
+void JitterEnableMultipleProducers(void *libjitter) {
+  auto *buffer = static_cast<JitterBuffer *>(libjitter);
+  buffer->EnableMultipleProducers();
+}
+
+void JitterEnableNotifications(void *libjitter) {
+  auto *buffer = static_cast<JitterBuffer *>(libjitter);
+  buffer->EnableNotifications();
+}
+
+void JitterEnableLazyConcealment(void *libjitter, const LibJitterConcealmentCallback concealment_callback, void *user_data) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    buffer->EnableLazyConcealment(concealment_callback != nullptr ? Trampoline(concealment_callback, user_data) : JitterBuffer::DeferredConcealmentCallback());
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+  }
+}
+
+void *JitterConcealmentWorkersInit(const size_t workers, cantina::Logger *logger) {
+  try {
+    return new std::shared_ptr<ConcealmentWorkers>(std::make_shared<ConcealmentWorkers>(workers, cantina::LoggerPointer(logger)));
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return nullptr;
+  }
+}
+
+void JitterConcealmentWorkersDrain(void *workers) {
+  (*static_cast<std::shared_ptr<ConcealmentWorkers> *>(workers))->Drain();
+}
+
+void JitterConcealmentWorkersDestroy(void *workers) {
+  delete static_cast<std::shared_ptr<ConcealmentWorkers> *>(workers);
+}
+
+void JitterEnableAsyncConcealment(void *libjitter, void *workers, const LibJitterConcealmentCallback concealment_callback, void *user_data) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    const auto *shared = static_cast<const std::shared_ptr<ConcealmentWorkers> *>(workers);
+    buffer->EnableAsyncConcealment(concealment_callback != nullptr ? Trampoline(concealment_callback, user_data) : JitterBuffer::DeferredConcealmentCallback(),
+                                   shared != nullptr ? *shared : nullptr);
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+  }
+}
+
+int JitterWaitForElements(void *libjitter, const size_t elements, const unsigned long timeout_ms) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    return buffer->WaitForElements(elements, std::chrono::milliseconds(timeout_ms)) ? 1 : 0;
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return -1;
+  }
+}
+
+int JitterGetNotificationFd(void *libjitter) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    return buffer->GetNotificationFd();
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+    return -1;
+  }
+}
+
+void JitterAcknowledgeNotification(void *libjitter) {
+  try {
+    auto *buffer = static_cast<JitterBuffer *>(libjitter);
+    buffer->AcknowledgeNotification();
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << std::endl;
+  }
+}
+
+unsigned long JitterGetCurrentDepth(void *libjitter) {
+  const auto *buffer = static_cast<const JitterBuffer *>(libjitter);
+  return static_cast<unsigned long>(buffer->GetCurrentDepth().count());
+}
+
+Metrics JitterGetMetrics(void *libjitter) {
+  const auto *buffer = static_cast<const JitterBuffer *>(libjitter);
+  return buffer->GetMetrics();
+}
+
 void JitterDestroy(void *libjitter) {
   delete static_cast<JitterBuffer *>(libjitter);
 }
@@ -1,12 +1,12 @@
 #include "BufferInspector.hh"
 #include "JitterBuffer.hh"
 
-BufferInspector::BufferInspector(JitterBuffer *buffer) {
+BufferInspector::BufferInspector(const JitterBuffer *buffer) {
   this->buffer = buffer;
 }
 
 std::size_t BufferInspector::GetWritten() const {
-  return this->buffer->written;
+  return this->buffer->head.bytes - this->buffer->tail.bytes;
 }
 
 std::size_t BufferInspector::GetReadOffset() const {
@@ -15,4 +15,12 @@ std::size_t BufferInspector::GetReadOffset() const {
 
 std::size_t BufferInspector::GetWriteOffset() const {
   return this->buffer->write_offset;
+}
+
+std::size_t BufferInspector::GetWrittenPackets() const {
+  return this->buffer->head.packets - this->buffer->tail.packets;
+}
+
+const Header *BufferInspector::GetHeader(const std::size_t packet_offset) const {
+  return &this->buffer->metadata[packet_offset % this->buffer->metadata_capacity];
 }
\ No newline at end of file
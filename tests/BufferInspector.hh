@@ -1,15 +1,17 @@
 #pragma once
 
-#include <cstddef>
+#include "JitterBuffer.hh"
 
-class JitterBuffer;
+#include <cstddef>
 
 class BufferInspector {
   public:
-      BufferInspector(JitterBuffer* buffer);
+      BufferInspector(const JitterBuffer* buffer);
       std::size_t GetWritten() const;
       std::size_t GetReadOffset() const;
       std::size_t GetWriteOffset() const;
+      std::size_t GetWrittenPackets() const;
+      const Header* GetHeader(std::size_t packet_offset) const;
   private:
-      JitterBuffer* buffer;
+      const JitterBuffer* buffer;
 };
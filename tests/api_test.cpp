@@ -4,7 +4,9 @@
 #include <memory>
 #include <map>
 #include "test_functions.h"
+#include <future>
 #include <thread>
+#include <poll.h>
 
 using namespace std::chrono;
 
@@ -174,6 +176,175 @@ TEST_CASE("libjitter::runover_read") {
   free(dequeued_data);
 }
 
+TEST_CASE("libjitter::peek_commit") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+
+  // Nothing to see yet.
+  CHECK_FALSE(buffer.PeekRead(frames_per_packet).has_value());
+
+  // Enqueue 1 and 2.
+  Packet packet1 = makeTestPacket(1, frame_size, frames_per_packet);
+  Packet packet2 = makeTestPacket(2, frame_size, frames_per_packet);
+  const std::size_t enqueued = buffer.Enqueue(
+          std::vector<Packet>{packet1, packet2},
+          [](const std::vector<Packet> &) {
+            FAIL("Unexpected concealment");
+          });
+  CHECK_EQ(enqueued, frames_per_packet * 2);
+
+  // Views never span packets.
+  std::optional<ReadView> view = buffer.PeekRead(512);
+  REQUIRE(view.has_value());
+  CHECK_EQ(view->elements, frames_per_packet);
+  CHECK_EQ(view->sequence_number, packet1.sequence_number);
+  CHECK_FALSE(view->concealment);
+  CHECK_EQ(0, memcmp(view->data, packet1.data, packet1.length));
+
+  // Peeking again without committing gives the same data.
+  CHECK_EQ(buffer.PeekRead(512)->data, view->data);
+  buffer.CommitRead(view->elements);
+  CHECK_EQ(milliseconds(10).count(), buffer.GetCurrentDepth().count());
+
+  // Partially consume 2, the rest should follow on.
+  view = buffer.PeekRead(100);
+  REQUIRE(view.has_value());
+  CHECK_EQ(view->elements, 100);
+  CHECK_EQ(view->sequence_number, packet2.sequence_number);
+  buffer.CommitRead(50);
+  view = buffer.PeekRead(frames_per_packet);
+  REQUIRE(view.has_value());
+  CHECK_EQ(view->elements, frames_per_packet - 50);
+  CHECK_EQ(view->sequence_number, packet2.sequence_number);
+  CHECK_EQ(0, memcmp(view->data, static_cast<std::uint8_t *>(packet2.data) + (50 * frame_size), view->elements * frame_size));
+  CHECK_THROWS_AS(buffer.CommitRead(frames_per_packet), const std::invalid_argument &);
+  buffer.CommitRead(view->elements);
+  CHECK_FALSE(buffer.PeekRead(frames_per_packet).has_value());
+  free(packet1.data);
+  free(packet2.data);
+}
+
+TEST_CASE("libjitter::commit_read_without_view") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+
+  // Releasing nothing on an empty buffer is a no-op, and consuming without a view throws.
+  CHECK_FALSE(buffer.PeekRead(frames_per_packet).has_value());
+  buffer.CommitRead(0);
+  CHECK_THROWS_AS(buffer.CommitRead(1), const std::runtime_error &);
+  Packet packet1 = makeTestPacket(1, frame_size, frames_per_packet);
+  CHECK_EQ(buffer.Enqueue(std::vector<Packet>{packet1}, [](const std::vector<Packet> &) {}), frames_per_packet);
+  std::optional<ReadView> view = buffer.PeekRead(frames_per_packet);
+  REQUIRE(view.has_value());
+  CHECK_EQ(view->sequence_number, packet1.sequence_number);
+
+  // Releasing again after a full commit doesn't skip the next packet.
+  buffer.CommitRead(view->elements);
+  buffer.CommitRead(0);
+  CHECK_EQ(buffer.GetCurrentDepth().count(), 0);
+  Packet packet2 = makeTestPacket(2, frame_size, frames_per_packet);
+  CHECK_EQ(buffer.Enqueue(std::vector<Packet>{packet2}, [](const std::vector<Packet> &) {}), frames_per_packet);
+  view = buffer.PeekRead(frames_per_packet);
+  REQUIRE(view.has_value());
+  CHECK_EQ(view->sequence_number, packet2.sequence_number);
+  CHECK_EQ(0, memcmp(view->data, packet2.data, packet2.length));
+
+  // Releasing a held view twice keeps it for the next read.
+  buffer.CommitRead(0);
+  buffer.CommitRead(0);
+  std::vector<std::uint8_t> destination(frame_size * frames_per_packet);
+  CHECK_EQ(buffer.Dequeue(destination.data(), destination.size(), frames_per_packet), frames_per_packet);
+  CHECK_EQ(0, memcmp(destination.data(), packet2.data, packet2.length));
+  free(packet1.data);
+  free(packet2.data);
+}
+
+TEST_CASE("libjitter::peek_concealment") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  Packet packet1 = makeTestPacket(1, frame_size, frames_per_packet);
+  Packet packet3 = makeTestPacket(3, frame_size, frames_per_packet);
+  buffer.Enqueue(std::vector<Packet>{packet1, packet3},
+                 [](std::vector<Packet> &packets) {
+                   for (auto &packet: packets) {
+                     memset(packet.data, 0, packet.length);
+                   }
+                 });
+  std::uint8_t *destination = static_cast<std::uint8_t *>(malloc(frame_size * frames_per_packet));
+  CHECK_EQ(frames_per_packet, buffer.Dequeue(destination, frame_size * frames_per_packet, frames_per_packet));
+  free(destination);
+
+  // Concealment packet 2 can't be updated while we're looking at it.
+  std::optional<ReadView> view = buffer.PeekRead(frames_per_packet);
+  REQUIRE(view.has_value());
+  CHECK(view->concealment);
+  CHECK_EQ(view->sequence_number, 2);
+  Packet update = makeTestPacket(2, frame_size, frames_per_packet);
+  CHECK_EQ(0, buffer.Enqueue(std::vector<Packet>{update}, [](const std::vector<Packet> &) {}));
+
+  // Once released, it can.
+  buffer.CommitRead(0);
+  CHECK_EQ(frames_per_packet, buffer.Enqueue(std::vector<Packet>{update}, [](const std::vector<Packet> &) {}));
+  view = buffer.PeekRead(frames_per_packet);
+  REQUIRE(view.has_value());
+  CHECK_FALSE(view->concealment);
+  CHECK_EQ(0, memcmp(view->data, update.data, update.length));
+  buffer.CommitRead(view->elements);
+  free(packet1.data);
+  free(packet3.data);
+  free(update.data);
+}
+
+TEST_CASE("libjitter::reserve_commit") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  CHECK_THROWS_AS(buffer.CommitWrite([](const std::vector<Packet> &) {}), const std::runtime_error &);
+
+  // Write 1 in place.
+  std::uint8_t *slot = buffer.ReserveWrite(1, frames_per_packet);
+  REQUIRE_NE(slot, nullptr);
+  memset(slot, 1, frames_per_packet * frame_size);
+  CHECK_EQ(0, buffer.GetCurrentDepth().count());
+  CHECK_EQ(frames_per_packet, buffer.CommitWrite([](const std::vector<Packet> &) {
+    FAIL("Unexpected concealment");
+  }));
+
+  // Writing 3 in place should conceal 2 in front of it on commit.
+  slot = buffer.ReserveWrite(3, frames_per_packet);
+  REQUIRE_NE(slot, nullptr);
+  memset(slot, 3, frames_per_packet * frame_size);
+  bool concealed = false;
+  CHECK_EQ(frames_per_packet * 2, buffer.CommitWrite([&concealed](std::vector<Packet> &packets) {
+    REQUIRE_EQ(packets.size(), 1);
+    CHECK_EQ(packets[0].sequence_number, 2);
+    memset(packets[0].data, 2, packets[0].length);
+    concealed = true;
+  }));
+  CHECK(concealed);
+
+  // Old sequence numbers can't be reserved.
+  CHECK_EQ(buffer.ReserveWrite(2, frames_per_packet), nullptr);
+
+  // Nor can empty packets, which leave nothing reserved to commit.
+  CHECK_THROWS_AS(buffer.ReserveWrite(4, 0), const std::invalid_argument &);
+  CHECK_THROWS_AS(buffer.CommitWrite([](const std::vector<Packet> &) {}), const std::runtime_error &);
+
+  // Everything should read back in order.
+  for (std::uint32_t sequence_number = 1; sequence_number <= 3; sequence_number++) {
+    std::optional<ReadView> view = buffer.PeekRead(frames_per_packet);
+    REQUIRE(view.has_value());
+    CHECK_EQ(view->sequence_number, sequence_number);
+    CHECK_EQ(view->concealment, sequence_number == 2);
+    CHECK_EQ(view->data[0], sequence_number);
+    CHECK_EQ(view->data[frames_per_packet * frame_size - 1], sequence_number);
+    buffer.CommitRead(view->elements);
+  }
+}
+
 TEST_CASE("libjitter::concealment") {
   const std::size_t frame_size = 2 * 2;
   const std::size_t frames_per_packet = 480;
@@ -385,6 +556,204 @@ TEST_CASE("libjitter::too_old") {
   free(destination);
 }
 
+TEST_CASE("libjitter::too_old_simulated_clock") {
+  const auto max_age = milliseconds(100);
+  const std::size_t frames_per_packet = 480;
+  nanoseconds now = seconds(1);
+  auto buffer = JitterBuffer(sizeof(std::size_t), frames_per_packet, 48000, max_age, milliseconds(0), logger, [&now]() { return now; });
+
+  Packet old_packet = makeTestPacket(1, sizeof(std::size_t), frames_per_packet);
+  REQUIRE_EQ(frames_per_packet, buffer.Enqueue(std::vector<Packet>{old_packet}, [](const std::vector<Packet> &) {}));
+  now += max_age;
+  Packet packet = makeTestPacket(2, sizeof(std::size_t), frames_per_packet);
+  REQUIRE_EQ(frames_per_packet, buffer.Enqueue(std::vector<Packet>{packet}, [](const std::vector<Packet> &) {}));
+
+  // Just before the first packet expires, we should get it back.
+  auto *destination = reinterpret_cast<std::uint8_t *>(calloc(1, sizeof(std::size_t) * frames_per_packet));
+  CHECK_EQ(frames_per_packet / 2, buffer.Dequeue(destination, sizeof(std::size_t) * frames_per_packet, frames_per_packet / 2, now - nanoseconds(1)));
+  CHECK_EQ(0, memcmp(destination, old_packet.data, sizeof(std::size_t) * frames_per_packet / 2));
+  CHECK_EQ(0, buffer.GetMetrics().skipped_frames);
+
+  // Now the rest of it has expired, and we get the second packet.
+  REQUIRE_EQ(frames_per_packet, buffer.Dequeue(destination, sizeof(std::size_t) * frames_per_packet, frames_per_packet));
+  CHECK_EQ(0, memcmp(destination, packet.data, sizeof(std::size_t) * frames_per_packet));
+  CHECK_EQ(frames_per_packet / 2, buffer.GetMetrics().skipped_frames);
+  free(old_packet.data);
+  free(packet.data);
+  free(destination);
+}
+
+TEST_CASE("libjitter::adaptive_depth") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  nanoseconds now = seconds(1);
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(200), milliseconds(100), logger, [&now]() { return now; });
+  CHECK_EQ(buffer.GetTargetDepth().count(), 100);
+  buffer.EnableAdaptiveDepth(milliseconds(20));
+  CHECK_EQ(buffer.GetTargetDepth().count(), 20);
+
+  // On a clean network, we should start playing at the floor rather than min_length.
+  std::uint32_t sequence_number = 0;
+  void *destination = malloc(frames_per_packet * frame_size);
+  auto enqueue = [&]() {
+    Packet packet = makeTestPacket(sequence_number++, frame_size, frames_per_packet);
+    const std::size_t enqueued = buffer.Enqueue(std::vector<Packet>{packet}, [](std::vector<Packet> &packets) {
+      for (auto &concealment: packets) {
+        memset(concealment.data, 0, concealment.length);
+      }
+    });
+    free(packet.data);
+    return enqueued;
+  };
+  enqueue();
+  now += milliseconds(10);
+  enqueue();
+  CHECK_EQ(buffer.GetTargetDepth().count(), 20);
+  CHECK_EQ(frames_per_packet, buffer.Dequeue(static_cast<std::uint8_t *>(destination), frames_per_packet * frame_size, frames_per_packet));
+
+  // Bursty arrival should raise the target.
+  for (std::size_t burst = 0; burst < 50; burst++) {
+    now += milliseconds(50);
+    for (std::size_t packet = 0; packet < 5; packet++) {
+      enqueue();
+      buffer.Dequeue(static_cast<std::uint8_t *>(destination), frames_per_packet * frame_size, frames_per_packet);
+    }
+  }
+  CHECK_GE(buffer.GetTargetDepth().count(), 50);
+  CHECK_LE(buffer.GetTargetDepth().count(), 200);
+  free(destination);
+}
+
+TEST_CASE("libjitter::adaptive_depth_large_media_time") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  nanoseconds now = seconds(1);
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(200), milliseconds(0), logger, [&now]() { return now; });
+  buffer.EnableAdaptiveDepth(milliseconds(20));
+
+  // A jump puts media time days ahead, past where it would overflow as nanoseconds times the clock rate.
+  std::uint32_t sequence_number = 0;
+  std::vector<std::uint8_t> destination(frames_per_packet * frame_size);
+  auto enqueue = [&]() {
+    Packet packet = makeTestPacket(sequence_number++, frame_size, frames_per_packet);
+    buffer.Enqueue(std::vector<Packet>{packet}, [](std::vector<Packet> &packets) {
+      for (auto &concealment: packets) {
+        memset(concealment.data, 0, concealment.length);
+      }
+    });
+    free(packet.data);
+    while (buffer.Dequeue(destination.data(), destination.size(), frames_per_packet) > 0) {
+    }
+    now += milliseconds(10);
+  };
+  for (std::size_t packet = 0; packet < 10; packet++) {
+    enqueue();
+  }
+  sequence_number = 100000000;
+  for (std::size_t packet = 0; packet < 300; packet++) {
+    enqueue();
+  }
+
+  // Arrivals are perfectly regular, so the target should stay at the floor.
+  CHECK_EQ(buffer.GetTargetDepth().count(), 20);
+}
+
+TEST_CASE("libjitter::span_concealment") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  const Packet first = makeTestPacket(1, frame_size, frames_per_packet);
+  CHECK_EQ(frames_per_packet, buffer.Enqueue(&first, 1, [](std::span<Packet>) {
+    FAIL("Unexpected concealment");
+  }));
+  free(first.data);
+
+  // Missing 2 & 3 should be handed over as a span into the buffer.
+  const Packet fourth = makeTestPacket(4, frame_size, frames_per_packet);
+  std::size_t concealed = 0;
+  CHECK_EQ(frames_per_packet * 3, buffer.Enqueue(&fourth, 1, [&concealed](std::span<Packet> packets) {
+    CHECK_EQ(packets.size(), 2);
+    for (Packet &packet: packets) {
+      CHECK_EQ(packet.sequence_number, 2 + concealed++);
+      CHECK_EQ(packet.elements, frames_per_packet);
+      memset(packet.data, 0, packet.length);
+    }
+  }));
+  CHECK_EQ(concealed, 2);
+  free(fourth.data);
+  CHECK_EQ(buffer.Prepare(6, [&concealed](std::span<Packet> packets) {
+    CHECK_EQ(packets.size(), 1);
+    CHECK_EQ(packets[0].sequence_number, 5);
+    concealed++;
+  }), frames_per_packet);
+  CHECK_EQ(concealed, 3);
+}
+
+TEST_CASE("libjitter::time_stretch") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(200), milliseconds(20), logger);
+
+  // Skip a fixed 48 elements per stretch.
+  std::size_t stretches = 0;
+  buffer.EnableTimeStretch([&stretches](const std::uint8_t *source, std::size_t source_elements, std::uint8_t *destination, std::size_t destination_elements) {
+    CHECK_GE(source_elements, destination_elements + 48);
+    memcpy(destination, source, destination_elements * 2 * 2);
+    stretches++;
+    return destination_elements + 48;
+  }, 48);
+
+  // Well over target.
+  for (std::uint32_t sequence_number = 0; sequence_number < 10; sequence_number++) {
+    Packet packet = makeTestPacket(sequence_number, frame_size, frames_per_packet);
+    buffer.Enqueue(std::vector<Packet>{packet}, [](const std::vector<Packet> &) {
+      FAIL("Unexpected concealment");
+    });
+    free(packet.data);
+  }
+  CHECK_EQ(buffer.GetCurrentDepth().count(), 100);
+
+  // Every dequeue should still be full, but drain faster than it plays.
+  void *destination = malloc(frames_per_packet * frame_size);
+  for (std::size_t dequeue = 0; dequeue < 5; dequeue++) {
+    CHECK_EQ(frames_per_packet, buffer.Dequeue(static_cast<std::uint8_t *>(destination), frames_per_packet * frame_size, frames_per_packet));
+  }
+  CHECK_EQ(stretches, 5);
+  CHECK_EQ(buffer.GetMetrics().accelerated_elements, 5 * 48);
+  CHECK_EQ(buffer.GetMetrics().decelerated_elements, 0);
+  CHECK_LT(buffer.GetCurrentDepth().count(), 50);
+  free(destination);
+}
+
+TEST_CASE("libjitter::compile_time_sizes") {
+  constexpr std::size_t frame_size = 2 * 2;
+  constexpr std::size_t frames_per_packet = 480;
+  auto buffer = BasicJitterBuffer<frame_size, frames_per_packet, 1 << 16>(48000, milliseconds(100), milliseconds(0), logger);
+  CHECK_EQ(buffer.GetElementSize(), frame_size);
+  CHECK_EQ(buffer.GetPacketElements(), frames_per_packet);
+  CHECK_EQ(buffer.GetCapacity(), 1 << 16);
+
+  // Go round the ring a few times.
+  void *destination = malloc(frames_per_packet * frame_size);
+  for (std::uint32_t sequence_number = 1; sequence_number < 200; sequence_number++) {
+    Packet packet = makeTestPacket(sequence_number, frame_size, frames_per_packet);
+    CHECK_EQ(frames_per_packet, buffer.Enqueue(&packet, 1, [](std::span<Packet>) {
+      FAIL("Unexpected concealment");
+    }));
+    CHECK_EQ(frames_per_packet, buffer.Dequeue(static_cast<std::uint8_t *>(destination), frames_per_packet * frame_size, frames_per_packet));
+    CHECK_EQ(memcmp(destination, packet.data, packet.length), 0);
+    free(packet.data);
+  }
+  free(destination);
+
+  // Given sizes must agree with fixed ones.
+  CHECK_THROWS_WITH_AS((BasicJitterBuffer<frame_size, frames_per_packet>(2, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger)),
+                       "Element size must be 4, got: 2",
+                       const std::invalid_argument &);
+  CHECK_THROWS_AS((BasicJitterBuffer<frame_size, frames_per_packet, 1000>(48000, milliseconds(100), milliseconds(0), logger)),
+                  const std::invalid_argument &);
+}
+
 TEST_CASE("libjitter::buffer_too_small")
 {
   auto buffer = JitterBuffer(2, 480, 100000, milliseconds(100), milliseconds(0), logger);
@@ -394,22 +763,113 @@ TEST_CASE("libjitter::buffer_too_small")
   free(dest);
 }
 
-TEST_CASE("libjitter::element_mismatch")
+TEST_CASE("libjitter::element_overflow")
 {
   auto buffer = JitterBuffer(2, 480, 96000, milliseconds(100), milliseconds(0), logger);
   auto packet = Packet {
     .sequence_number = 1,
     .data = nullptr,
     .length = 0,
-    .elements = 960,
+    .elements = 70000,
   };
   std::vector<Packet> packets;
   packets.push_back(packet);
   CHECK_THROWS_WITH_AS(buffer.Enqueue(packets, [](const std::vector<Packet>&){}),
-                       "Supplied packet elements must match declared number of elements. Got: 960, expected: 480",
+                       "Packets should be at most 65535 elements. Got: 70000",
+                       const std::invalid_argument&);
+}
+
+TEST_CASE("libjitter::element_underflow")
+{
+  auto buffer = JitterBuffer(2, 480, 48000, milliseconds(100), milliseconds(0), logger);
+  auto packet = Packet {
+    .sequence_number = 1,
+    .data = nullptr,
+    .length = 0,
+    .elements = 0,
+  };
+  CHECK_THROWS_WITH_AS(buffer.Enqueue(std::vector<Packet>{packet}, [](const std::vector<Packet>&){}),
+                       "Packets should have at least 1 element.",
                        const std::invalid_argument&);
 }
 
+TEST_CASE("libjitter::fill_sub_millisecond")
+{
+  const std::size_t frame_size = 2 * 2;
+  auto buffer = JitterBuffer(frame_size, 480, 48000, milliseconds(100), milliseconds(20), logger);
+
+  // Reach the minimum depth and start playing, then drain.
+  Packet packet1 = makeTestPacket(1, frame_size, 480);
+  Packet packet2 = makeTestPacket(2, frame_size, 480);
+  CHECK_EQ(480 * 2, buffer.Enqueue(std::vector<Packet>{packet1, packet2}, [](const std::vector<Packet> &) {
+    FAIL("Unexpected concealment");
+  }));
+  std::vector<std::uint8_t> destination(480 * 2 * frame_size);
+  CHECK_EQ(480 * 2, buffer.Dequeue(destination.data(), destination.size(), 480 * 2));
+
+  // A 0.5ms packet should fill the 10ms gap with 20 more of the same.
+  Packet packet3 = makeTestPacket(3, frame_size, 24);
+  std::size_t filled = 0;
+  CHECK_EQ(24 * 21, buffer.Enqueue(std::vector<Packet>{packet3}, [&filled](std::vector<Packet> &packets) {
+    for (Packet &packet: packets) {
+      CHECK_EQ(packet.elements, 24);
+      memset(packet.data, 0, packet.length);
+    }
+    filled += packets.size();
+  }));
+  CHECK_EQ(filled, 20);
+  CHECK_EQ(buffer.GetMetrics().filled_packets, 24 * 20);
+  CHECK_EQ(buffer.GetCurrentDepth().count(), 10);
+  free(packet1.data);
+  free(packet2.data);
+  free(packet3.data);
+}
+
+TEST_CASE("libjitter::variable_duration")
+{
+  const std::size_t frame_size = 2 * 2;
+  auto buffer = JitterBuffer(frame_size, 480, 48000, milliseconds(200), milliseconds(0), logger);
+
+  // 10ms, then 20ms.
+  Packet packet1 = makeTestPacket(1, frame_size, 480);
+  Packet packet2 = makeTestPacket(2, frame_size, 960);
+  CHECK_EQ(480 + 960, buffer.Enqueue(std::vector<Packet>{packet1, packet2}, [](const std::vector<Packet> &) {
+    FAIL("Unexpected concealment");
+  }));
+
+  // A gap should be concealed at the sender's latest duration.
+  Packet packet5 = makeTestPacket(5, frame_size, 960);
+  CHECK_EQ(960 * 3, buffer.Enqueue(std::vector<Packet>{packet5}, [](std::vector<Packet> &packets) {
+    CHECK_EQ(packets.size(), 2);
+    for (Packet &packet: packets) {
+      CHECK_EQ(packet.elements, 960);
+      memset(packet.data, 0, packet.length);
+    }
+  }));
+  CHECK_EQ(buffer.GetCurrentDepth().count(), 10 + 20 + 40 + 20);
+  CHECK(checkPacketInSlot(&buffer, packet2, 1));
+  CHECK(checkPacketInSlot(&buffer, packet5, 4));
+
+  // Updates must match the concealed duration.
+  Packet short3 = makeTestPacket(3, frame_size, 480);
+  Packet packet4 = makeTestPacket(4, frame_size, 960);
+  CHECK_EQ(0, buffer.Enqueue(std::vector<Packet>{short3}, [](const std::vector<Packet> &) {}));
+  CHECK_EQ(buffer.GetMetrics().update_missed_frames, 480);
+  CHECK_EQ(960, buffer.Enqueue(std::vector<Packet>{packet4}, [](const std::vector<Packet> &) {}));
+  CHECK(checkPacketInSlot(&buffer, packet4, 3));
+
+  // Everything reads back out in order.
+  std::vector<std::uint8_t> destination(480 * 9 * frame_size);
+  CHECK_EQ(480 * 9, buffer.Dequeue(destination.data(), destination.size(), 480 * 9));
+  CHECK_EQ(0, memcmp(destination.data(), packet1.data, packet1.length));
+  CHECK_EQ(0, memcmp(destination.data() + packet1.length, packet2.data, packet2.length));
+  free(packet1.data);
+  free(packet2.data);
+  free(short3.data);
+  free(packet4.data);
+  free(packet5.data);
+}
+
 TEST_CASE("libjitter::packet_less_than_1ms") {
   CHECK_THROWS_WITH_AS(JitterBuffer(2, 10, 48000, milliseconds(100), milliseconds(0), logger),
                        "Packets should be at least 1ms.",
@@ -567,4 +1027,443 @@ TEST_CASE("libjitter::play") {
   free(destination);
 }
 
-// TODO: Test for only dequeing some of packet, then dequeueing the rest.
\ No newline at end of file
+// TODO: Test for only dequeing some of packet, then dequeueing the rest.
+TEST_CASE("libjitter::metrics") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  const std::size_t capacity_packets = buffer.GetCapacity() / (frame_size * frames_per_packet);
+
+  // Overfill in one go, so the packets that don't fit are dropped.
+  std::vector<Packet> packets;
+  for (std::size_t sequence_number = 1; sequence_number <= capacity_packets + 2; sequence_number++) {
+    packets.push_back(makeTestPacket(sequence_number, frame_size, frames_per_packet));
+  }
+  CHECK_EQ(buffer.Enqueue(packets, [](const std::vector<Packet> &) {}), capacity_packets * frames_per_packet);
+  Metrics metrics = buffer.GetMetrics();
+  CHECK_EQ(metrics.enqueued_elements, capacity_packets * frames_per_packet);
+  CHECK_EQ(metrics.dropped_packets, 2);
+  CHECK_EQ(metrics.dequeued_elements, 0);
+
+  // Reading is counted, and a packet already played is a duplicate.
+  std::vector<std::uint8_t> destination(frame_size * frames_per_packet);
+  CHECK_EQ(buffer.Dequeue(destination.data(), destination.size(), frames_per_packet), frames_per_packet);
+  CHECK_EQ(buffer.Enqueue(&packets[0], 1, [](const std::vector<Packet> &) {}), 0);
+  metrics = buffer.GetMetrics();
+  CHECK_EQ(metrics.dequeued_elements, frames_per_packet);
+  CHECK_EQ(metrics.duplicate_packets, 1);
+  CHECK_EQ(metrics.update_missed_frames, 0);
+
+  // Snapshots from another thread only ever move forward.
+  std::atomic<bool> done = false;
+  std::thread poller([&]() {
+    Metrics last = buffer.GetMetrics();
+    while (!done) {
+      const Metrics now = buffer.GetMetrics();
+      CHECK_GE(now.dequeued_elements, last.dequeued_elements);
+      CHECK_GE(now.enqueued_elements, last.enqueued_elements);
+      last = now;
+    }
+  });
+  for (std::size_t read = 0; read < 100; read++) {
+    buffer.Dequeue(destination.data(), destination.size(), frames_per_packet);
+    Packet packet = makeTestPacket(capacity_packets + 3 + read, frame_size, frames_per_packet);
+    buffer.Enqueue(&packet, 1, [](const std::vector<Packet> &) {});
+    free(packet.data);
+  }
+  done = true;
+  poller.join();
+  metrics = buffer.GetMetrics();
+  CHECK_EQ(metrics.dequeued_elements, 101 * frames_per_packet);
+  for (Packet &packet: packets) {
+    free(packet.data);
+  }
+}
+
+TEST_CASE("libjitter::spsc_stress") {
+  // A ring of a few packets, so both sides wrap it thousands of times. Time stands still, so nothing expires.
+  const std::size_t frame_size = sizeof(std::uint32_t);
+  const std::size_t frames_per_packet = 480;
+  const std::uint32_t packets = 5000;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(50), milliseconds(0), logger, []() {
+    return nanoseconds(0);
+  });
+
+  // Every element is stamped with its position in the stream, and packets vary in length.
+  std::atomic<bool> concealed = false;
+  std::thread writer([&]() {
+    std::vector<std::uint32_t> samples(frames_per_packet);
+    std::uint32_t stamp = 0;
+    for (std::uint32_t sequence_number = 0; sequence_number < packets; sequence_number++) {
+      const std::size_t elements = frames_per_packet - (sequence_number % 7) * 40;
+      for (std::size_t index = 0; index < elements; index++) {
+        samples[index] = stamp++;
+      }
+      const Packet packet = {.sequence_number = sequence_number, .data = samples.data(), .length = elements * frame_size, .elements = elements};
+      while (buffer.GetCurrentDepth() > milliseconds(30)) {
+        std::this_thread::yield();
+      }
+      CHECK_EQ(buffer.Enqueue(&packet, 1, [&concealed](std::span<Packet>) { concealed = true; }), elements);
+    }
+  });
+
+  // Reads straddle packets and the end of the ring, and must see every element once, in order.
+  std::vector<std::uint32_t> destination(frames_per_packet);
+  std::uint32_t expected = 0;
+  std::uint32_t total = 0;
+  for (std::uint32_t sequence_number = 0; sequence_number < packets; sequence_number++) {
+    total += static_cast<std::uint32_t>(frames_per_packet - (sequence_number % 7) * 40);
+  }
+  std::size_t mismatches = 0;
+  while (expected < total) {
+    const std::size_t wanted = std::min<std::size_t>(317, total - expected);
+    const std::size_t dequeued = buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * frame_size, wanted);
+    for (std::size_t index = 0; index < dequeued; index++) {
+      mismatches += destination[index] != expected++;
+    }
+    if (dequeued == 0) {
+      std::this_thread::yield();
+    }
+  }
+  writer.join();
+  CHECK_EQ(mismatches, 0);
+  CHECK_FALSE(concealed);
+  const Metrics metrics = buffer.GetMetrics();
+  CHECK_EQ(metrics.enqueued_elements, total);
+  CHECK_EQ(metrics.dequeued_elements, total);
+  CHECK_EQ(metrics.dropped_packets, 0);
+  CHECK_EQ(metrics.skipped_frames, 0);
+}
+
+TEST_CASE("libjitter::multiple_producers") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  const std::size_t producers = 4;
+  const std::size_t packets_each = 25;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(2000), milliseconds(0), logger);
+  buffer.EnableMultipleProducers();
+  Packet first = makeTestPacket(0, frame_size, frames_per_packet);
+  buffer.Enqueue(&first, 1, [](std::span<Packet>) {});
+
+  // Each producer has every fourth packet, so they arrive out of order: gaps are concealed, then updated.
+  std::vector<std::thread> threads;
+  for (std::size_t producer = 0; producer < producers; producer++) {
+    threads.emplace_back([&, producer]() {
+      for (std::size_t index = 0; index < packets_each; index++) {
+        Packet packet = makeTestPacket((index * producers) + producer + 1, frame_size, frames_per_packet);
+        buffer.Enqueue(&packet, 1, [](std::span<Packet> packets) {
+          for (Packet &concealment: packets) {
+            memset(concealment.data, 0, concealment.length);
+          }
+        });
+        free(packet.data);
+      }
+    });
+  }
+  for (std::thread &thread: threads) {
+    thread.join();
+  }
+
+  // Every packet ends up in place with its own data.
+  std::vector<std::uint8_t> destination(frame_size * frames_per_packet);
+  for (std::size_t sequence_number = 0; sequence_number <= producers * packets_each; sequence_number++) {
+    Packet expected = makeTestPacket(sequence_number, frame_size, frames_per_packet);
+    REQUIRE_EQ(buffer.Dequeue(destination.data(), destination.size(), frames_per_packet), frames_per_packet);
+    CHECK_EQ(memcmp(destination.data(), expected.data, expected.length), 0);
+    free(expected.data);
+  }
+  CHECK_EQ(buffer.GetMetrics().enqueued_elements + buffer.GetMetrics().updated_frames, ((producers * packets_each) + 1) * frames_per_packet);
+  free(first.data);
+}
+
+TEST_CASE("libjitter::multiple_producers_reservation_misuse") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  buffer.EnableMultipleProducers();
+
+  // One producer holds a reservation, and can't take another.
+  std::uint8_t *slot = buffer.ReserveWrite(0, frames_per_packet);
+  REQUIRE_NE(slot, nullptr);
+  CHECK_THROWS_AS(buffer.ReserveWrite(1, frames_per_packet), const std::runtime_error &);
+
+  // Another producer committing without a reservation waits its turn, finds nothing reserved, and doesn't take the
+  // first producer's lock with it.
+  std::atomic<bool> threw = false;
+  std::thread other([&]() {
+    try {
+      buffer.CommitWrite([](std::span<Packet>) {});
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+  });
+  std::this_thread::sleep_for(milliseconds(10));
+  memset(slot, 0, frames_per_packet * frame_size);
+  CHECK_EQ(buffer.CommitWrite([](std::span<Packet>) { FAIL("Unexpected concealment"); }), frames_per_packet);
+  other.join();
+  CHECK(threw);
+
+  // Neither left the producer lock held.
+  std::thread writer([&]() {
+    Packet packet = makeTestPacket(1, frame_size, frames_per_packet);
+    CHECK_EQ(buffer.Enqueue(&packet, 1, [](std::span<Packet>) {}), frames_per_packet);
+    free(packet.data);
+    CHECK_NE(buffer.ReserveWrite(2, frames_per_packet), nullptr);
+    CHECK_EQ(buffer.CommitWrite([](std::span<Packet>) {}), frames_per_packet);
+  });
+  writer.join();
+}
+
+TEST_CASE("libjitter::notifications") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  CHECK_THROWS_AS(buffer.WaitForElements(frames_per_packet, milliseconds(1)), const std::runtime_error &);
+  buffer.EnableNotifications();
+
+  // Nothing arrives in time.
+  CHECK_FALSE(buffer.WaitForElements(frames_per_packet, milliseconds(1)));
+
+  // The descriptor becomes readable once data lands.
+  pollfd descriptor = {.fd = buffer.GetNotificationFd(), .events = POLLIN, .revents = 0};
+  CHECK_EQ(poll(&descriptor, 1, 0), 0);
+  Packet packet = makeTestPacket(0, frame_size, frames_per_packet);
+  buffer.Enqueue(&packet, 1, [](std::span<Packet>) {});
+  free(packet.data);
+  CHECK_EQ(poll(&descriptor, 1, 0), 1);
+  buffer.AcknowledgeNotification();
+  CHECK_EQ(poll(&descriptor, 1, 0), 0);
+  CHECK(buffer.WaitForElements(frames_per_packet, milliseconds(0)));
+
+  // A waiting reader is woken by a writer on another thread.
+  std::thread writer([&]() {
+    std::this_thread::sleep_for(milliseconds(10));
+    Packet next = makeTestPacket(1, frame_size, frames_per_packet);
+    buffer.Enqueue(&next, 1, [](std::span<Packet>) {});
+    free(next.data);
+  });
+  CHECK(buffer.WaitForElements(2 * frames_per_packet, seconds(10)));
+  writer.join();
+  CHECK_EQ(poll(&descriptor, 1, 0), 1);
+}
+
+TEST_CASE("libjitter::dequeue_mix") {
+  const std::size_t frame_size = sizeof(std::int16_t);
+  const std::size_t frames_per_packet = 4;
+  auto loud = JitterBuffer(frame_size, frames_per_packet, 4000, milliseconds(100), milliseconds(0), logger);
+  auto quiet = JitterBuffer(frame_size, frames_per_packet, 4000, milliseconds(100), milliseconds(0), logger);
+  std::vector<std::int16_t> samples(frames_per_packet, 20000);
+  for (const unsigned long sequence_number: {0, 1}) {
+    const Packet packet = {.sequence_number = sequence_number, .data = samples.data(), .length = samples.size() * frame_size, .elements = frames_per_packet};
+    loud.Enqueue(&packet, 1, [](std::span<Packet>) {});
+    if (sequence_number == 0) {
+      quiet.Enqueue(&packet, 1, [](std::span<Packet>) {});
+    }
+  }
+
+  // Sums saturate, and the shorter source leaves the rest to the longer one.
+  const JitterBuffer::MixSource sources[] = {{&loud, 1}, {&quiet, 0.25F}};
+  std::vector<std::int16_t> destination(2 * frames_per_packet, 1);
+  CHECK_EQ(JitterBuffer::DequeueMix(sources, SampleType::Int16, reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * frame_size, destination.size()), 2 * frames_per_packet);
+  CHECK_EQ(destination, (std::vector<std::int16_t>{25000, 25000, 25000, 25000, 20000, 20000, 20000, 20000}));
+  CHECK_EQ(loud.GetMetrics().dequeued_elements, 2 * frames_per_packet);
+  CHECK_EQ(quiet.GetMetrics().dequeued_elements, frames_per_packet);
+
+  for (const unsigned long sequence_number: {2, 1}) {
+    const Packet packet = {.sequence_number = sequence_number, .data = samples.data(), .length = samples.size() * frame_size, .elements = frames_per_packet};
+    (sequence_number == 2 ? loud : quiet).Enqueue(&packet, 1, [](std::span<Packet>) {});
+  }
+  const JitterBuffer::MixSource both[] = {{&loud, 1}, {&quiet, 1}};
+  CHECK_EQ(JitterBuffer::DequeueMix(both, SampleType::Int16, reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * frame_size, frames_per_packet), frames_per_packet);
+  CHECK_EQ(destination[0], 32767);
+}
+
+TEST_CASE("libjitter::drift_compensation") {
+  const std::size_t frames_per_packet = 480;
+  nanoseconds now = seconds(1);
+  auto buffer = JitterBuffer(sizeof(std::int16_t), frames_per_packet, 48000, milliseconds(1000), milliseconds(60), logger, [&now]() { return now; });
+  buffer.EnableDriftCompensation({SampleType::Int16, SampleLayout::Interleaved, 1}, seconds(10));
+
+  // The sender's clock runs 200ppm fast, which would otherwise build up 24ms over two minutes.
+  std::vector<std::int16_t> samples(frames_per_packet, 1000);
+  std::vector<std::int16_t> destination(frames_per_packet);
+  const nanoseconds send_interval = duration_cast<nanoseconds>(milliseconds(10) / 1.0002);
+  nanoseconds next_send = now;
+  nanoseconds next_read = now;
+  unsigned long sequence_number = 0;
+  while (now < seconds(121)) {
+    if (next_send <= next_read) {
+      now = next_send;
+      const Packet packet = {.sequence_number = sequence_number++, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = frames_per_packet};
+      buffer.Enqueue(&packet, 1, [](std::span<Packet>) { FAIL("Nothing should be concealed"); });
+      next_send += send_interval;
+    } else {
+      now = next_read;
+      buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), frames_per_packet);
+      next_read += milliseconds(10);
+    }
+  }
+  CHECK_GT(buffer.GetClockDrift(), 150);
+  CHECK_LT(buffer.GetClockDrift(), 250);
+  // Held on target, less the packet just read.
+  CHECK_LE(buffer.GetCurrentDepth(), milliseconds(65));
+  CHECK_GE(buffer.GetCurrentDepth(), milliseconds(45));
+  CHECK_EQ(buffer.GetMetrics().skipped_frames, 0);
+
+  // Resampling a constant leaves it untouched.
+  CHECK_EQ(destination[0], 1000);
+  CHECK_EQ(destination[frames_per_packet - 1], 1000);
+}
+
+TEST_CASE("libjitter::drift_compensation_underrun") {
+  const std::size_t frames_per_packet = 480;
+  nanoseconds now = seconds(1);
+  auto buffer = JitterBuffer(sizeof(std::int16_t), frames_per_packet, 48000, milliseconds(1000), milliseconds(60), logger, [&now]() { return now; });
+  buffer.EnableDriftCompensation({SampleType::Int16, SampleLayout::Interleaved, 1}, seconds(10));
+
+  // The clocks match, but the sender goes quiet for a couple of seconds at a time, starving the reader.
+  std::vector<std::int16_t> samples(frames_per_packet, 1000);
+  std::vector<std::int16_t> destination(frames_per_packet);
+  nanoseconds next_send = now;
+  nanoseconds next_read = now;
+  unsigned long sequence_number = 0;
+  double worst = 0;
+  while (now < seconds(121)) {
+    if (next_send <= next_read) {
+      now = next_send;
+      if (now % seconds(20) < seconds(18)) {
+        const Packet packet = {.sequence_number = sequence_number++, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = frames_per_packet};
+        buffer.Enqueue(&packet, 1, [](std::span<Packet> packets) {
+          for (Packet &filled: packets) {
+            memset(filled.data, 0, filled.length);
+          }
+        });
+      }
+      next_send += milliseconds(10);
+    } else {
+      now = next_read;
+      buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), frames_per_packet);
+      next_read += milliseconds(10);
+      if (now > seconds(21)) {
+        worst = std::max(worst, std::abs(buffer.GetClockDrift()));
+      }
+    }
+  }
+  // Starved reads aren't mistaken for the reader running fast. What's left is filling to the minimum depth after each
+  // gap, ahead of the sender, which real packets then catch up with.
+  CHECK_LT(worst, 2000);
+}
+
+TEST_CASE("libjitter::lazy_concealment") {
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(sizeof(std::int16_t), frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  std::vector<std::uint32_t> concealed;
+  buffer.EnableLazyConcealment([&concealed](const std::span<Packet> packets) {
+    for (Packet &packet: packets) {
+      concealed.push_back(static_cast<std::uint32_t>(packet.sequence_number));
+      std::fill_n(static_cast<std::int16_t *>(packet.data), packet.elements, -1);
+    }
+  });
+  const auto enqueue = [&buffer](const unsigned long sequence_number) {
+    std::vector<std::int16_t> samples(frames_per_packet, static_cast<std::int16_t>(sequence_number));
+    const Packet packet = {.sequence_number = sequence_number, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = frames_per_packet};
+    return buffer.Enqueue(&packet, 1, [](std::span<Packet>) { FAIL("Only the lazy callback should conceal"); });
+  };
+
+  // 1 and 2 go missing, but nothing is synthesized for them yet.
+  CHECK_EQ(enqueue(0), frames_per_packet);
+  CHECK_EQ(enqueue(3), 3 * frames_per_packet);
+  CHECK(concealed.empty());
+  CHECK_EQ(buffer.GetMetrics().concealed_frames, 2 * frames_per_packet);
+
+  // 1 turns up late, and is copied into its placeholder.
+  CHECK_EQ(enqueue(1), frames_per_packet);
+  CHECK_EQ(buffer.GetMetrics().updated_frames, frames_per_packet);
+
+  // Only 2, still missing when read, gets concealed.
+  std::vector<std::int16_t> destination(4 * frames_per_packet);
+  REQUIRE_EQ(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), destination.size()), destination.size());
+  CHECK_EQ(concealed, std::vector<std::uint32_t>{2});
+  CHECK_EQ(destination[0], 0);
+  CHECK_EQ(destination[frames_per_packet], 1);
+  CHECK_EQ(destination[2 * frames_per_packet], -1);
+  CHECK_EQ(destination[3 * frames_per_packet], 3);
+}
+
+TEST_CASE("libjitter::async_concealment") {
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(sizeof(std::int16_t), frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  auto workers = std::make_shared<ConcealmentWorkers>(1, logger);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  buffer.EnableAsyncConcealment([released](const std::span<Packet> packets) {
+    // Slow concealment, held up until the test lets it go.
+    released.wait();
+    for (Packet &packet: packets) {
+      std::fill_n(static_cast<std::int16_t *>(packet.data), packet.elements, -1);
+    }
+  }, workers);
+  const auto enqueue = [&buffer](const unsigned long sequence_number) {
+    std::vector<std::int16_t> samples(frames_per_packet, static_cast<std::int16_t>(sequence_number));
+    const Packet packet = {.sequence_number = sequence_number, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = frames_per_packet};
+    return buffer.Enqueue(&packet, 1, [](std::span<Packet>) { FAIL("Only the async callback should conceal"); });
+  };
+
+  // The writer doesn't wait for 1 to be synthesized, and a read skips it while pending.
+  CHECK_EQ(enqueue(0), frames_per_packet);
+  CHECK_EQ(enqueue(2), 2 * frames_per_packet);
+  CHECK_EQ(buffer.GetMetrics().concealed_frames, frames_per_packet);
+  std::vector<std::int16_t> destination(2 * frames_per_packet);
+  REQUIRE_EQ(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), destination.size()), destination.size());
+  CHECK_EQ(destination[0], 0);
+  CHECK_EQ(destination[frames_per_packet], 2);
+
+  // Once synthesized, concealment plays as usual.
+  release.set_value();
+  CHECK_EQ(enqueue(4), 2 * frames_per_packet);
+  workers->Drain();
+  REQUIRE_EQ(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), destination.size()), destination.size());
+  CHECK_EQ(destination[0], -1);
+  CHECK_EQ(destination[frames_per_packet], 4);
+}
+
+TEST_CASE("libjitter::async_concealment_update") {
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(sizeof(std::int16_t), frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  auto workers = std::make_shared<ConcealmentWorkers>(1, logger);
+  std::promise<void> start;
+  std::future<void> started = start.get_future();
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  buffer.EnableAsyncConcealment([&start, released](const std::span<Packet> packets) {
+    start.set_value();
+    released.wait();
+    for (Packet &packet: packets) {
+      std::fill_n(static_cast<std::int16_t *>(packet.data), packet.elements, -1);
+    }
+  }, workers);
+  const auto enqueue = [&buffer](const unsigned long sequence_number) {
+    std::vector<std::int16_t> samples(frames_per_packet, static_cast<std::int16_t>(sequence_number));
+    const Packet packet = {.sequence_number = sequence_number, .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = frames_per_packet};
+    return buffer.Enqueue(&packet, 1, [](std::span<Packet>) { FAIL("Only the async callback should conceal"); });
+  };
+
+  // 1 arrives late, while the worker is still synthesizing it. The real packet wins.
+  CHECK_EQ(enqueue(0), frames_per_packet);
+  CHECK_EQ(enqueue(2), 2 * frames_per_packet);
+  started.wait();
+  CHECK_EQ(enqueue(1), frames_per_packet);
+  Metrics metrics = buffer.GetMetrics();
+  CHECK_EQ(metrics.updated_frames, frames_per_packet);
+  CHECK_EQ(metrics.update_missed_frames, 0);
+
+  // Finishing the synthesis leaves it alone.
+  release.set_value();
+  workers->Drain();
+  std::vector<std::int16_t> destination(3 * frames_per_packet);
+  REQUIRE_EQ(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), destination.size()), destination.size());
+  CHECK_EQ(destination[0], 0);
+  CHECK_EQ(destination[frames_per_packet], 1);
+  CHECK_EQ(destination[(2 * frames_per_packet) - 1], 1);
+  CHECK_EQ(destination[2 * frames_per_packet], 2);
+}
@@ -0,0 +1,93 @@
+#include <doctest/doctest.h>
+#include "JitterBuffer.hh"
+#include "RingArena.hh"
+#include "test_functions.h"
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+using namespace std::chrono;
+
+TEST_CASE("libjitter_arena::mirror_and_recycle") {
+  RingArena arena(1024 * 1024);
+  const Ring first = arena.Allocate(6000);
+  CHECK_GE(first.length, 6000);
+  CHECK_EQ(first.backing, RingBacking::Standard);
+  const Ring second = arena.Allocate(6000);
+  CHECK_EQ(second.length, first.length);
+  CHECK_NE(first.address, second.address);
+  CHECK_EQ(arena.GetRegions(), 1);
+
+  // Writes past the end of a ring land at its start, and rings don't overlap.
+  memset(first.address, 0, first.length);
+  memset(second.address, 0xFF, second.length);
+  first.address[first.length] = 1;
+  CHECK_EQ(first.address[0], 1);
+  CHECK_EQ(second.address[0], 0xFF);
+
+  // A released ring is handed out again.
+  arena.Release(first);
+  CHECK_EQ(arena.GetFreeRings(), 1);
+  CHECK_EQ(arena.Allocate(6000).address, first.address);
+  CHECK_EQ(arena.GetFreeRings(), 0);
+  arena.Release(first);
+  arena.Release(second);
+
+  // Rings too big for a region get their own.
+  const Ring big = arena.Allocate(2 * 1024 * 1024);
+  CHECK_EQ(arena.GetRegions(), 2);
+  arena.Release(big);
+}
+
+TEST_CASE("libjitter_arena::huge_pages") {
+  // Whatever the system offers, rings work, and report their backing.
+  RingArena arena(RingArena::DEFAULT_REGION_SIZE, true);
+  const Ring ring = arena.Allocate(RingArena::HUGE_PAGE_SIZE + 6000);
+  CHECK_EQ(ring.backing, arena.GetBacking());
+  if (ring.backing != RingBacking::Standard) {
+    CHECK_EQ(ring.length, 2 * RingArena::HUGE_PAGE_SIZE);
+    CHECK_EQ(reinterpret_cast<std::uintptr_t>(ring.address) % RingArena::HUGE_PAGE_SIZE, 0);
+  }
+  memset(ring.address, 0, ring.length);
+  ring.address[ring.length] = 1;
+  CHECK_EQ(ring.address[0], 1);
+
+  // Rings smaller than a huge page aren't rounded up to one.
+  const Ring small = arena.Allocate(6000);
+  CHECK_EQ(small.backing, RingBacking::Standard);
+  CHECK_LT(small.length, RingArena::HUGE_PAGE_SIZE);
+  memset(small.address, 0, small.length);
+  small.address[small.length] = 1;
+  CHECK_EQ(small.address[0], 1);
+  CHECK_EQ(ring.address[0], 1);
+  arena.Release(ring);
+  arena.Release(small);
+}
+
+TEST_CASE("libjitter_arena::buffer") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto logger = std::make_shared<cantina::Logger>("ARENA", "TEST");
+  auto arena = std::make_shared<RingArena>();
+  {
+    JitterBuffer buffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger, nullptr, arena);
+    CHECK_EQ(arena.use_count(), 2);
+
+    // Enough packets to wrap the ring.
+    std::vector<std::uint8_t> destination(frame_size * frames_per_packet);
+    for (std::uint32_t sequence_number = 0; sequence_number < 30; sequence_number++) {
+      Packet packet = makeTestPacket(sequence_number, frame_size, frames_per_packet, sequence_number);
+      CHECK_EQ(buffer.Enqueue({packet}, [](const std::vector<Packet> &) {}), frames_per_packet);
+      CHECK_EQ(buffer.Dequeue(destination.data(), destination.size(), frames_per_packet), frames_per_packet);
+      CHECK_EQ(memcmp(destination.data(), packet.data, packet.length), 0);
+      free(packet.data);
+    }
+  }
+  CHECK_EQ(arena.use_count(), 1);
+  CHECK_EQ(arena->GetFreeRings(), 1);
+
+  // The next buffer of the same size reuses the ring.
+  JitterBuffer buffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger, nullptr, arena);
+  CHECK_EQ(arena->GetFreeRings(), 0);
+  CHECK_EQ(arena->GetRegions(), 1);
+}
@@ -0,0 +1,249 @@
+#include <doctest/doctest.h>
+#include "libjitter.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+  constexpr size_t frame_size = 2 * 2;
+  constexpr size_t frames_per_packet = 480;
+
+  void *makeBuffer(const unsigned long min_length_ms = 0) {
+    // The buffer takes ownership of the logger.
+    return JitterInit(frame_size, frames_per_packet, 48000, 100, min_length_ms, new cantina::Logger("", ""));
+  }
+
+  struct Concealed {
+    std::vector<unsigned long> sequence_numbers;
+  };
+
+  void conceal(struct Packet *packets, const size_t num_packets, void *user_data) {
+    auto *concealed = static_cast<Concealed *>(user_data);
+    for (size_t index = 0; index < num_packets; index++) {
+      memset(packets[index].data, 0xFF, packets[index].length);
+      concealed->sequence_numbers.push_back(packets[index].sequence_number);
+    }
+  }
+
+  void unexpected(struct Packet *, const size_t, void *) {
+    FAIL("Unexpected concealment");
+  }
+}
+
+TEST_CASE("libjitter_c_api::create_destroy") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+  CHECK_EQ(JitterGetCurrentDepth(buffer), 0);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::invalid_create") {
+  // Packets shorter than 1ms are rejected.
+  cantina::Logger *logger = new cantina::Logger("", "");
+  CHECK_EQ(JitterInit(frame_size, 10, 48000, 100, 0, logger), nullptr);
+}
+
+TEST_CASE("libjitter_c_api::enqueue_dequeue") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+
+  // 1 and 3 arrive, so 2 is concealed.
+  std::vector<std::uint8_t> data1(frames_per_packet * frame_size, 1);
+  std::vector<std::uint8_t> data3(frames_per_packet * frame_size, 3);
+  const struct Packet packets[] = {
+    {.sequence_number = 1, .data = data1.data(), .length = data1.size(), .elements = frames_per_packet},
+    {.sequence_number = 3, .data = data3.data(), .length = data3.size(), .elements = frames_per_packet},
+  };
+  Concealed concealed;
+  CHECK_EQ(JitterEnqueue(buffer, packets, 2, conceal, &concealed), frames_per_packet * 3);
+  CHECK_EQ(concealed.sequence_numbers, std::vector<unsigned long>{2});
+  CHECK_EQ(JitterGetCurrentDepth(buffer), 30);
+
+  std::vector<std::uint8_t> destination(frames_per_packet * frame_size * 3);
+  CHECK_EQ(JitterDequeue(buffer, destination.data(), destination.size(), frames_per_packet * 3), frames_per_packet * 3);
+  CHECK_EQ(0, memcmp(destination.data(), data1.data(), data1.size()));
+  CHECK_EQ(destination[data1.size()], 0xFF);
+  CHECK_EQ(0, memcmp(destination.data() + data1.size() * 2, data3.data(), data3.size()));
+
+  const struct Metrics metrics = JitterGetMetrics(buffer);
+  CHECK_EQ(metrics.concealed_frames, frames_per_packet);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::peek_commit_read") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+  struct JitterReadView view {};
+  CHECK_EQ(JitterPeekRead(buffer, frames_per_packet, &view), 0);
+
+  std::vector<std::uint8_t> data(frames_per_packet * frame_size, 1);
+  const struct Packet packet = {.sequence_number = 1, .data = data.data(), .length = data.size(), .elements = frames_per_packet};
+  CHECK_EQ(JitterEnqueue(buffer, &packet, 1, unexpected, nullptr), frames_per_packet);
+
+  // Read half in place, then the rest.
+  REQUIRE_EQ(JitterPeekRead(buffer, frames_per_packet / 2, &view), 1);
+  CHECK_EQ(view.elements, frames_per_packet / 2);
+  CHECK_EQ(view.sequence_number, 1);
+  CHECK_EQ(view.concealment, 0);
+  CHECK_EQ(0, memcmp(view.data, data.data(), view.elements * frame_size));
+  JitterCommitRead(buffer, view.elements);
+  REQUIRE_EQ(JitterPeekRead(buffer, frames_per_packet, &view), 1);
+  CHECK_EQ(view.elements, frames_per_packet / 2);
+  JitterCommitRead(buffer, view.elements);
+  CHECK_EQ(JitterPeekRead(buffer, frames_per_packet, &view), 0);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::commit_read_without_view") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+  struct JitterReadView view {};
+
+  // Committing with nothing peeked, on an empty buffer or after a full commit, leaves later packets playable.
+  CHECK_EQ(JitterPeekRead(buffer, frames_per_packet, &view), 0);
+  JitterCommitRead(buffer, 0);
+  JitterCommitRead(buffer, 1);
+  std::vector<std::uint8_t> data(frames_per_packet * frame_size, 1);
+  struct Packet packet = {.sequence_number = 1, .data = data.data(), .length = data.size(), .elements = frames_per_packet};
+  CHECK_EQ(JitterEnqueue(buffer, &packet, 1, unexpected, nullptr), frames_per_packet);
+  REQUIRE_EQ(JitterPeekRead(buffer, frames_per_packet, &view), 1);
+  CHECK_EQ(view.sequence_number, 1);
+  JitterCommitRead(buffer, view.elements);
+  JitterCommitRead(buffer, 0);
+
+  packet.sequence_number = 2;
+  CHECK_EQ(JitterEnqueue(buffer, &packet, 1, unexpected, nullptr), frames_per_packet);
+  REQUIRE_EQ(JitterPeekRead(buffer, frames_per_packet, &view), 1);
+  CHECK_EQ(view.sequence_number, 2);
+  CHECK_EQ(view.elements, frames_per_packet);
+  JitterCommitRead(buffer, view.elements);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::reserve_commit_write") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+
+  void *slot = JitterReserveWrite(buffer, 1, frames_per_packet);
+  REQUIRE_NE(slot, nullptr);
+  memset(slot, 1, frames_per_packet * frame_size);
+  CHECK_EQ(JitterCommitWrite(buffer, unexpected, nullptr), frames_per_packet);
+
+  std::vector<std::uint8_t> destination(frames_per_packet * frame_size);
+  CHECK_EQ(JitterDequeue(buffer, destination.data(), destination.size(), frames_per_packet), frames_per_packet);
+  CHECK_EQ(destination.front(), 1);
+  CHECK_EQ(destination.back(), 1);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::errors") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+
+  // Invalid packets enqueue nothing.
+  const struct Packet overflow = {.sequence_number = 1, .data = nullptr, .length = 0, .elements = 70000};
+  CHECK_EQ(JitterEnqueue(buffer, &overflow, 1, unexpected, nullptr), 0);
+
+  // Empty reservations fail, and leave nothing to commit.
+  CHECK_EQ(JitterReserveWrite(buffer, 1, 0), nullptr);
+  CHECK_EQ(JitterCommitWrite(buffer, unexpected, nullptr), 0);
+
+  // Double reservations fail, without losing the first.
+  void *slot = JitterReserveWrite(buffer, 1, frames_per_packet);
+  REQUIRE_NE(slot, nullptr);
+  CHECK_EQ(JitterReserveWrite(buffer, 2, frames_per_packet), nullptr);
+  memset(slot, 1, frames_per_packet * frame_size);
+  CHECK_EQ(JitterCommitWrite(buffer, unexpected, nullptr), frames_per_packet);
+
+  // Destinations that are too small dequeue nothing.
+  std::vector<std::uint8_t> destination(frames_per_packet * frame_size);
+  CHECK_EQ(JitterDequeue(buffer, destination.data(), destination.size() - 1, frames_per_packet), 0);
+
+  // Committing more than was peeked consumes nothing.
+  struct JitterReadView view {};
+  REQUIRE_EQ(JitterPeekRead(buffer, frames_per_packet, &view), 1);
+  JitterCommitRead(buffer, frames_per_packet + 1);
+  CHECK_EQ(JitterDequeue(buffer, destination.data(), destination.size(), frames_per_packet), frames_per_packet);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::notifications") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+
+  // Without notifications enabled, these fail rather than throw.
+  CHECK_EQ(JitterWaitForElements(buffer, frames_per_packet, 0), -1);
+  CHECK_EQ(JitterGetNotificationFd(buffer), -1);
+  JitterAcknowledgeNotification(buffer);
+
+  JitterEnableNotifications(buffer);
+  CHECK_GE(JitterGetNotificationFd(buffer), 0);
+  CHECK_EQ(JitterWaitForElements(buffer, frames_per_packet, 0), 0);
+  std::vector<std::uint8_t> data(frames_per_packet * frame_size, 1);
+  const struct Packet packet = {.sequence_number = 1, .data = data.data(), .length = data.size(), .elements = frames_per_packet};
+  CHECK_EQ(JitterEnqueue(buffer, &packet, 1, unexpected, nullptr), frames_per_packet);
+  CHECK_EQ(JitterWaitForElements(buffer, frames_per_packet, 0), 1);
+  JitterAcknowledgeNotification(buffer);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::lazy_concealment") {
+  void *buffer = makeBuffer();
+  REQUIRE_NE(buffer, nullptr);
+
+  // A missing callback is reported rather than thrown, and leaves concealment inline.
+  JitterEnableLazyConcealment(buffer, nullptr, nullptr);
+  Concealed concealed;
+  JitterEnableLazyConcealment(buffer, conceal, &concealed);
+
+  // The gap is only filled when the read reaches it.
+  std::vector<std::uint8_t> data1(frames_per_packet * frame_size, 1);
+  std::vector<std::uint8_t> data3(frames_per_packet * frame_size, 3);
+  const struct Packet packets[] = {
+    {.sequence_number = 1, .data = data1.data(), .length = data1.size(), .elements = frames_per_packet},
+    {.sequence_number = 3, .data = data3.data(), .length = data3.size(), .elements = frames_per_packet},
+  };
+  CHECK_EQ(JitterEnqueue(buffer, packets, 2, unexpected, nullptr), frames_per_packet * 3);
+  CHECK(concealed.sequence_numbers.empty());
+  std::vector<std::uint8_t> destination(frames_per_packet * frame_size * 3);
+  CHECK_EQ(JitterDequeue(buffer, destination.data(), destination.size(), frames_per_packet * 3), frames_per_packet * 3);
+  CHECK_EQ(concealed.sequence_numbers, std::vector<unsigned long>{2});
+  CHECK_EQ(destination[data1.size()], 0xFF);
+  JitterDestroy(buffer);
+}
+
+TEST_CASE("libjitter_c_api::async_concealment") {
+  void *workers = JitterConcealmentWorkersInit(1, new cantina::Logger("", ""));
+  REQUIRE_NE(workers, nullptr);
+  void *first = makeBuffer();
+  void *second = makeBuffer();
+  REQUIRE_NE(first, nullptr);
+  REQUIRE_NE(second, nullptr);
+
+  // Missing workers or callbacks are reported rather than thrown.
+  JitterEnableAsyncConcealment(first, nullptr, conceal, nullptr);
+  JitterEnableAsyncConcealment(first, workers, nullptr, nullptr);
+
+  // Both buffers share the workers, which outlive the handle.
+  Concealed concealed[2];
+  JitterEnableAsyncConcealment(first, workers, conceal, &concealed[0]);
+  JitterEnableAsyncConcealment(second, workers, conceal, &concealed[1]);
+  std::vector<std::uint8_t> data1(frames_per_packet * frame_size, 1);
+  std::vector<std::uint8_t> data3(frames_per_packet * frame_size, 3);
+  const struct Packet packets[] = {
+    {.sequence_number = 1, .data = data1.data(), .length = data1.size(), .elements = frames_per_packet},
+    {.sequence_number = 3, .data = data3.data(), .length = data3.size(), .elements = frames_per_packet},
+  };
+  CHECK_EQ(JitterEnqueue(first, packets, 2, unexpected, nullptr), frames_per_packet * 3);
+  CHECK_EQ(JitterEnqueue(second, packets, 2, unexpected, nullptr), frames_per_packet * 3);
+  JitterConcealmentWorkersDrain(workers);
+  JitterConcealmentWorkersDestroy(workers);
+  for (std::size_t index = 0; index < 2; index++) {
+    CHECK_EQ(concealed[index].sequence_numbers, std::vector<unsigned long>{2});
+  }
+  std::vector<std::uint8_t> destination(frames_per_packet * frame_size * 3);
+  CHECK_EQ(JitterDequeue(first, destination.data(), destination.size(), frames_per_packet * 3), frames_per_packet * 3);
+  CHECK_EQ(destination[data1.size()], 0xFF);
+  JitterDestroy(first);
+  JitterDestroy(second);
+}
@@ -0,0 +1,176 @@
+#include <doctest/doctest.h>
+#include "Concealment.hh"
+#include "JitterBuffer.hh"
+#include <cmath>
+#include <cstdlib>
+#include <numbers>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace {
+  // 200Hz at 48kHz, so exactly 240 elements per period.
+  std::vector<std::int16_t> makeSine(const std::size_t first, const std::size_t elements) {
+    std::vector<std::int16_t> samples(elements);
+    for (std::size_t index = 0; index < elements; index++) {
+      samples[index] = static_cast<std::int16_t>(std::lround(10000 * std::sin(2 * std::numbers::pi * 200 * static_cast<double>(first + index) / 48000)));
+    }
+    return samples;
+  }
+
+  template<typename Sample>
+  Packet makePacket(std::vector<Sample> &samples, const std::size_t channels) {
+    return Packet{
+            .sequence_number = 0,
+            .data = samples.data(),
+            .length = samples.size() * sizeof(Sample),
+            .elements = samples.size() / channels};
+  }
+
+  template<typename Sample>
+  double rms(const std::vector<Sample> &samples) {
+    double energy = 0;
+    for (const Sample sample: samples) {
+      energy += static_cast<double>(sample) * static_cast<double>(sample);
+    }
+    return std::sqrt(energy / static_cast<double>(samples.size()));
+  }
+}
+
+TEST_CASE("libjitter_concealment::silence") {
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::Silence, 2, 48000);
+  std::vector<std::int16_t> samples(480 * 2, 1);
+  Packet packet = makePacket(samples, 2);
+  concealer(std::span<Packet>(&packet, 1));
+  CHECK_EQ(rms(samples), 0);
+}
+
+TEST_CASE("libjitter_concealment::repeat") {
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::Repeat, 1, 48000, milliseconds(20));
+  std::vector<std::int16_t> last(480, 10000);
+  concealer.Observe(makePacket(last, 1));
+
+  // The fade runs across packets, down to silence after 20ms.
+  std::vector<std::vector<std::int16_t>> concealed(3, std::vector<std::int16_t>(480, 1));
+  std::vector<Packet> packets;
+  for (auto &samples: concealed) {
+    packets.push_back(makePacket(samples, 1));
+  }
+  concealer(std::span<Packet>(packets.data(), 2));
+  concealer(std::span<Packet>(packets.data() + 2, 1));
+  CHECK_EQ(concealed[0][0], 10000);
+  CHECK_EQ(concealed[0][240], 7500);
+  CHECK_EQ(concealed[1][0], 5000);
+  CHECK_GT(concealed[1][479], 0);
+  CHECK_EQ(rms(concealed[2]), 0);
+
+  // Real audio restarts the fade.
+  concealer.Observe(makePacket(last, 1));
+  concealer(std::span<Packet>(packets.data(), 1));
+  CHECK_EQ(concealed[0][0], 10000);
+}
+
+TEST_CASE("libjitter_concealment::pitch_repetition") {
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::PitchRepetition, 1, 48000, seconds(100));
+  std::vector<std::int16_t> history = makeSine(0, 1920);
+  concealer.Observe(makePacket(history, 1));
+
+  // Repeating the last period carries the tone on seamlessly.
+  std::vector<std::int16_t> samples(480);
+  Packet packet = makePacket(samples, 1);
+  concealer(std::span<Packet>(&packet, 1));
+  const std::vector<std::int16_t> expected = makeSine(1920, 480);
+  for (std::size_t index = 0; index < samples.size(); index++) {
+    REQUIRE_LE(std::abs(samples[index] - expected[index]), 2);
+  }
+}
+
+TEST_CASE("libjitter_concealment::history_wraps") {
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::PitchRepetition, 1, 48000, seconds(100));
+
+  // Odd sized packets leave the newest audio straddling the end of the history ring.
+  const std::size_t packet_elements = 333;
+  std::size_t observed = 0;
+  for (std::size_t packet_index = 0; packet_index < 7; packet_index++) {
+    std::vector<std::int16_t> samples = makeSine(observed, packet_elements);
+    concealer.Observe(makePacket(samples, 1));
+    observed += packet_elements;
+  }
+  std::vector<std::int16_t> samples(480);
+  Packet packet = makePacket(samples, 1);
+  concealer(std::span<Packet>(&packet, 1));
+  const std::vector<std::int16_t> expected = makeSine(observed, 480);
+  for (std::size_t index = 0; index < samples.size(); index++) {
+    REQUIRE_LE(std::abs(samples[index] - expected[index]), 2);
+  }
+}
+
+TEST_CASE("libjitter_concealment::history_grows") {
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::Repeat, 1, 48000, seconds(1000));
+  std::vector<std::int16_t> small(480, 1);
+  concealer.Observe(makePacket(small, 1));
+
+  // A packet longer than the history is still repeated whole.
+  std::vector<std::int16_t> large(4000);
+  for (std::size_t index = 0; index < large.size(); index++) {
+    large[index] = static_cast<std::int16_t>(index);
+  }
+  concealer.Observe(makePacket(large, 1));
+  std::vector<std::int16_t> samples(4000);
+  Packet packet = makePacket(samples, 1);
+  concealer(std::span<Packet>(&packet, 1));
+  for (std::size_t index = 0; index < samples.size(); index += 500) {
+    CHECK_LE(std::abs(samples[index] - large[index]), 1);
+  }
+
+  // Then smaller packets carry on as normal.
+  std::vector<std::int16_t> after(480, 7);
+  concealer.Observe(makePacket(after, 1));
+  std::vector<std::int16_t> repeated(480);
+  Packet next = makePacket(repeated, 1);
+  concealer(std::span<Packet>(&next, 1));
+  CHECK_EQ(repeated[0], 7);
+  CHECK_GE(repeated[479], 6);
+}
+
+TEST_CASE("libjitter_concealment::comfort_noise") {
+  auto concealer = Concealer<float>(ConcealmentStrategy::ComfortNoise, 2, 48000);
+  std::vector<float> loud(480 * 2, 0.5F);
+  std::vector<float> quiet(480 * 2, 0.01F);
+  concealer.Observe(makePacket(quiet, 2));
+  concealer.Observe(makePacket(loud, 2));
+
+  // Noise sits near the quietest recent level, not the loudest.
+  std::vector<float> samples(483 * 2);
+  Packet packet = makePacket(samples, 2);
+  concealer(std::span<Packet>(&packet, 1));
+  CHECK_GT(rms(samples), 0.01);
+  CHECK_LT(rms(samples), 0.05);
+  CHECK_NE(samples[0], samples[1]);
+}
+
+TEST_CASE("libjitter_concealment::mismatched_packet") {
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::Repeat, 2, 48000);
+  std::vector<std::int16_t> samples(480 * 2);
+  Packet packet = makePacket(samples, 1);
+  CHECK_THROWS_AS(concealer.Observe(packet), const std::invalid_argument &);
+}
+
+TEST_CASE("libjitter_concealment::buffer") {
+  auto buffer = JitterBuffer(sizeof(std::int16_t), 480, 48000, milliseconds(100), milliseconds(0), std::make_shared<cantina::Logger>("", ""));
+  auto concealer = Concealer<std::int16_t>(ConcealmentStrategy::Repeat, 1, 48000);
+  std::vector<std::int16_t> samples(480, 1000);
+  Packet packet = makePacket(samples, 1);
+  for (const unsigned long sequence_number: {0, 2}) {
+    packet.sequence_number = sequence_number;
+    concealer.Observe(packet);
+    buffer.Enqueue(&packet, 1, concealer);
+  }
+
+  // The gap is the last packet again, fading.
+  std::vector<std::int16_t> destination(480);
+  REQUIRE_EQ(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), 480), 480);
+  REQUIRE_EQ(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(std::int16_t), 480), 480);
+  CHECK_EQ(destination[0], 1000);
+  CHECK_LT(destination[479], 1000);
+}
@@ -0,0 +1,88 @@
+#include <doctest/doctest.h>
+#include "DriftEstimator.hh"
+#include "JitterEstimator.hh"
+#include <chrono>
+
+using namespace std::chrono;
+
+TEST_CASE("libjitter_estimator::steady") {
+  auto estimator = JitterEstimator(milliseconds(10), milliseconds(200), 0.95f);
+  for (std::uint32_t sequence_number = 0; sequence_number < 100; sequence_number++) {
+    estimator.Arrival(sequence_number, milliseconds(1000) + (sequence_number * milliseconds(10)));
+  }
+  CHECK_EQ(estimator.GetJitter().count(), 0);
+  CHECK_EQ(estimator.GetDelay().count(), 0);
+}
+
+TEST_CASE("libjitter_estimator::jittery") {
+  auto estimator = JitterEstimator(milliseconds(10), milliseconds(200), 0.95f);
+
+  // Every 4th packet is 30ms late.
+  for (std::uint32_t sequence_number = 0; sequence_number < 400; sequence_number++) {
+    const milliseconds late = sequence_number % 4 == 0 ? milliseconds(30) : milliseconds(0);
+    estimator.Arrival(sequence_number, milliseconds(1000) + (sequence_number * milliseconds(10)) + late);
+  }
+  CHECK_GT(estimator.GetJitter(), milliseconds(10));
+  CHECK_EQ(estimator.GetDelay().count(), 30);
+
+  // Once the network calms down, the estimate should come back down.
+  for (std::uint32_t sequence_number = 400; sequence_number < 3000; sequence_number++) {
+    estimator.Arrival(sequence_number, milliseconds(1000) + (sequence_number * milliseconds(10)));
+  }
+  CHECK_LT(estimator.GetJitter(), milliseconds(1));
+  CHECK_EQ(estimator.GetDelay().count(), 0);
+}
+
+TEST_CASE("libjitter_estimator::clamped") {
+  auto estimator = JitterEstimator(milliseconds(10), milliseconds(100), 1.0f);
+  estimator.Arrival(0, milliseconds(0));
+  estimator.Arrival(1, milliseconds(500));
+  CHECK_EQ(estimator.GetDelay().count(), 100);
+}
+
+TEST_CASE("libjitter_estimator::variable_duration") {
+  auto estimator = JitterEstimator(milliseconds(10), milliseconds(200), 0.95f);
+
+  // Switching from 10ms to 20ms packets on time shouldn't look like delay.
+  milliseconds media_time(0);
+  for (std::uint32_t packet = 0; packet < 200; packet++) {
+    const milliseconds duration = packet < 100 ? milliseconds(10) : milliseconds(20);
+    estimator.Arrival(nanoseconds(media_time), milliseconds(1000) + media_time);
+    media_time += duration;
+  }
+  CHECK_EQ(estimator.GetJitter().count(), 0);
+  CHECK_EQ(estimator.GetDelay().count(), 0);
+}
+
+TEST_CASE("libjitter_estimator::drift") {
+  auto estimator = DriftEstimator(seconds(10));
+
+  // 100ppm fast arrivals, in bursts of 10ms, against steady reads.
+  for (std::uint64_t step = 0; step <= 2000; step++) {
+    const nanoseconds now = seconds(1) + (step * milliseconds(10));
+    const std::uint64_t arrived = static_cast<std::uint64_t>(static_cast<double>(step) * 480 * 1.0001) + (step % 3 == 0 ? 480 : 0);
+    estimator.Arrived(arrived, now);
+    estimator.Consumed(step * 480, now);
+    if (step < 1000) {
+      CHECK_FALSE(estimator.GetDrift().has_value());
+    }
+  }
+  REQUIRE(estimator.GetDrift().has_value());
+  CHECK_GT(estimator.GetDrift().value() * 1e6, 80);
+  CHECK_LT(estimator.GetDrift().value() * 1e6, 120);
+}
+
+TEST_CASE("libjitter_estimator::renormalized") {
+  auto estimator = JitterEstimator(milliseconds(10), milliseconds(200), 0.95f);
+
+  // Long enough for the sample weights to be renormalized, which mustn't upset the tracked quantile.
+  for (std::uint32_t sequence_number = 0; sequence_number < 150000; sequence_number++) {
+    const milliseconds late = sequence_number % 4 == 0 ? milliseconds(30) : milliseconds(0);
+    estimator.Arrival(sequence_number, milliseconds(1000) + (sequence_number * milliseconds(10)) + late);
+  }
+  CHECK_EQ(estimator.GetDelay().count(), 30);
+  for (std::uint32_t sequence_number = 150000; sequence_number < 153000; sequence_number++) {
+    estimator.Arrival(sequence_number, milliseconds(1000) + (sequence_number * milliseconds(10)));
+  }
+  CHECK_EQ(estimator.GetDelay().count(), 0);
+}
@@ -0,0 +1,64 @@
+#include <doctest/doctest.h>
+#include "Histogram.hh"
+#include "JitterBuffer.hh"
+#include "test_functions.h"
+#include <chrono>
+#include <memory>
+
+using namespace std::chrono;
+
+TEST_CASE("libjitter_histogram::buckets") {
+  // Every value lands in a bucket whose bound is within 25% above it.
+  for (std::uint64_t value = 0; value < 100000; value++) {
+    const std::size_t bucket = Histogram::Bucket(value);
+    CHECK_GE(Histogram::UpperBound(bucket), value);
+    CHECK_LE(Histogram::UpperBound(bucket), value + (value / 4));
+    if (bucket > 0) {
+      CHECK_LT(Histogram::UpperBound(bucket - 1), value);
+    }
+  }
+  CHECK_EQ(Histogram::Bucket(UINT64_MAX), Histogram::BUCKETS - 1);
+  CHECK_EQ(Histogram::UpperBound(Histogram::BUCKETS - 1), UINT64_MAX);
+
+  Histogram histogram;
+  CHECK_EQ(histogram.Percentile(0.5), 0);
+  for (std::uint64_t value = 1; value <= 100; value++) {
+    histogram.Record(value);
+  }
+  CHECK_EQ(histogram.GetCount(), 100);
+  CHECK_EQ(histogram.Percentile(0.5), Histogram::UpperBound(Histogram::Bucket(50)));
+  CHECK_EQ(histogram.Percentile(1), Histogram::UpperBound(Histogram::Bucket(100)));
+  CHECK_EQ(histogram.Percentile(0), 1);
+  CHECK_THROWS_AS(histogram.Percentile(1.5), const std::invalid_argument &);
+}
+
+TEST_CASE("libjitter_histogram::buffer") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  nanoseconds now = seconds(1);
+  auto logger = std::make_shared<cantina::Logger>("HIST", "TEST");
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(200), milliseconds(0), logger, [&now]() { return now; });
+
+  // Packets arrive on time, except every fourth, 4ms late. Each is read 30ms after it's written.
+  for (std::uint32_t sequence_number = 0; sequence_number < 40; sequence_number++) {
+    const nanoseconds lateness = sequence_number % 4 == 3 ? milliseconds(4) : milliseconds(0);
+    now = seconds(1) + (milliseconds(10) * sequence_number) + lateness;
+    Packet packet = makeTestPacket(sequence_number, frame_size, frames_per_packet);
+    buffer.Enqueue(&packet, 1, [](const std::vector<Packet> &) {});
+    free(packet.data);
+    if (sequence_number >= 3) {
+      std::vector<std::uint8_t> destination(frame_size * frames_per_packet);
+      const nanoseconds written = seconds(1) + (milliseconds(10) * (sequence_number - 3)) + (sequence_number % 4 == 2 ? milliseconds(4) : milliseconds(0));
+      CHECK_EQ(buffer.Dequeue(destination.data(), destination.size(), frames_per_packet, written + milliseconds(30)), frames_per_packet);
+    }
+  }
+
+  const Histograms &histograms = buffer.GetHistograms();
+  CHECK_EQ(histograms.arrival_jitter.GetCount(), 39);
+  CHECK_EQ(histograms.arrival_jitter.Percentile(0.5), 0);
+  CHECK_EQ(histograms.arrival_jitter.Percentile(1), Histogram::UpperBound(Histogram::Bucket(4000)));
+  CHECK_EQ(histograms.residence.GetCount(), 37);
+  CHECK_EQ(histograms.residence.Percentile(0.5), Histogram::UpperBound(Histogram::Bucket(30000)));
+  CHECK_EQ(histograms.depth.GetCount(), 37);
+  CHECK_EQ(histograms.depth.Percentile(1), Histogram::UpperBound(Histogram::Bucket(40000)));
+}
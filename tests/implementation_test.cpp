@@ -28,12 +28,46 @@ TEST_CASE("libjitter_implementation::enqueue") {
   CHECK_EQ(enqueued, packet.elements);
 
   // Check internals of buffer.
-  const std::size_t expected_bytes = packet.elements * frame_size + JitterBuffer::METADATA_SIZE;
+  const std::size_t expected_bytes = packet.elements * frame_size;
   CHECK_EQ(0, memcmp(packet.data, buffer.GetReadPointerAtPacketOffset(0), frame_size * frames_per_packet));
   free(packet.data);
   CHECK_EQ(expected_bytes, inspector.GetWritten());
   CHECK_EQ(0, inspector.GetReadOffset());
   CHECK_EQ(expected_bytes, inspector.GetWriteOffset());
+  CHECK_EQ(1, inspector.GetWrittenPackets());
+}
+
+TEST_CASE("libjitter_implementation::metadata_table") {
+  const std::size_t frame_size = sizeof(int);
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  auto inspector = BufferInspector(&buffer);
+
+  // Write 1 and 3, concealing 2.
+  Packet packet1 = makeTestPacket(1, frame_size, frames_per_packet);
+  Packet packet3 = makeTestPacket(3, frame_size, frames_per_packet);
+  buffer.Enqueue(std::vector<Packet>{packet1, packet3}, [](const std::vector<Packet> &) {});
+  CHECK_EQ(3, inspector.GetWrittenPackets());
+  CHECK_EQ(frames_per_packet * frame_size * 3, inspector.GetWritten());
+  for (std::size_t slot = 0; slot < 3; slot++) {
+    const Header *header = inspector.GetHeader(slot);
+    CHECK_EQ(header->sequence_number, slot + 1);
+    CHECK_EQ(header->elements, frames_per_packet);
+    CHECK_EQ((header->state & Header::CONCEALMENT) != 0, slot == 1);
+  }
+
+  // A partial read frees its space straight away and shrinks the header in place.
+  const std::size_t to_dequeue = frames_per_packet + 100;
+  std::uint8_t *destination = static_cast<std::uint8_t *>(malloc(to_dequeue * frame_size));
+  CHECK_EQ(to_dequeue, buffer.Dequeue(destination, to_dequeue * frame_size, to_dequeue));
+  free(destination);
+  CHECK_EQ(2, inspector.GetWrittenPackets());
+  CHECK_EQ(to_dequeue * frame_size, inspector.GetReadOffset());
+  CHECK_EQ((frames_per_packet * 3 - to_dequeue) * frame_size, inspector.GetWritten());
+  CHECK_EQ(inspector.GetHeader(1)->sequence_number, 2);
+  CHECK_EQ(inspector.GetHeader(1)->elements, frames_per_packet - 100);
+  free(packet1.data);
+  free(packet3.data);
 }
 
 TEST_CASE("libjitter_implementation::concealment") {
@@ -239,6 +273,48 @@ TEST_CASE("libjitter_implementation::update_existing_partial_read") {
   }
 }
 
+TEST_CASE("libjitter_implementation::update_indexed") {
+  // Push 1 and 6 to generate 2-5, then update out of order.
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto buffer = JitterBuffer(frame_size, frames_per_packet, 48000, milliseconds(100), milliseconds(0), logger);
+  Packet packet1 = makeTestPacket(1, frame_size, frames_per_packet);
+  Packet packet6 = makeTestPacket(6, frame_size, frames_per_packet);
+  const std::size_t enqueued = buffer.Enqueue(
+          std::vector<Packet>{packet1, packet6},
+          [](std::vector<Packet> &packets) {
+            CHECK_EQ(packets.size(), 4);
+            for (auto &packet: packets) {
+              memset(packet.data, 0, packet.length);
+            }
+          });
+  CHECK_EQ(enqueued, frames_per_packet * 6);
+
+  // Updates land in the right slot regardless of order.
+  Packet packet4 = makeTestPacket(4, frame_size, frames_per_packet);
+  Packet packet2 = makeTestPacket(2, frame_size, frames_per_packet);
+  CHECK_EQ(frames_per_packet * 2, buffer.Enqueue(std::vector<Packet>{packet4, packet2}, [](const std::vector<Packet> &) {}));
+  CHECK(checkPacketInSlot(&buffer, packet1, 0));
+  CHECK(checkPacketInSlot(&buffer, packet2, 1));
+  CHECK(checkPacketInSlot(&buffer, packet4, 3));
+  CHECK(checkPacketInSlot(&buffer, packet6, 5));
+
+  // Duplicates of real data are ignored.
+  CHECK_EQ(0, buffer.Enqueue(std::vector<Packet>{packet4, packet1}, [](const std::vector<Packet> &) {}));
+  CHECK_EQ(buffer.GetMetrics().updated_frames, frames_per_packet * 2);
+  CHECK_EQ(buffer.GetMetrics().duplicate_packets, 2);
+
+  // Sequence numbers we've never seen can't be updated.
+  Packet packet0 = makeTestPacket(0, frame_size, frames_per_packet);
+  CHECK_EQ(0, buffer.Enqueue(std::vector<Packet>{packet0}, [](const std::vector<Packet> &) {}));
+  CHECK_EQ(buffer.GetMetrics().update_missed_frames, frames_per_packet);
+  free(packet0.data);
+  free(packet1.data);
+  free(packet2.data);
+  free(packet4.data);
+  free(packet6.data);
+}
+
 TEST_CASE("libjitter_implementation::checkPacketInSlot") {
   // Push 1 and 3 to generate 2, then update 2.
   const std::size_t frame_size = 2 * 2;
@@ -256,7 +332,7 @@ TEST_CASE("libjitter_implementation::checkPacketInSlot") {
   CHECK_EQ(enqueued, packet.elements);
 
   const std::uint8_t* read = buffer.GetReadPointerAtPacketOffset(0);
-  const Header* retrieved = reinterpret_cast<const Header*>(read - JitterBuffer::METADATA_SIZE);
+  const Header* retrieved = BufferInspector(&buffer).GetHeader(0);
 
   // Make sure the header looks good, and the data has been updated.
   CHECK_EQ(retrieved->sequence_number, packet.sequence_number);
@@ -0,0 +1,109 @@
+#include <doctest/doctest.h>
+#include "JitterBufferPool.hh"
+#include "test_functions.h"
+#include <chrono>
+#include <map>
+#include <thread>
+
+using namespace std::chrono;
+
+TEST_CASE("libjitter_pool::dequeue_all") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 480;
+  auto logger = std::make_shared<cantina::Logger>("POOL", "TEST");
+  JitterBufferPool pool(2, [](JitterBufferPool::StreamId, std::span<Packet>) {
+    FAIL("Unexpected concealment");
+  }, logger, false);
+
+  std::vector<JitterBufferPool::StreamId> streams;
+  for (std::size_t stream = 0; stream < 4; stream++) {
+    streams.push_back(pool.AddStream(frame_size, frames_per_packet, 48000, milliseconds(500), milliseconds(0)));
+  }
+
+  // Each stream's packets are filled with its own identifier, enqueued from two threads.
+  auto produce = [&](const std::size_t first) {
+    for (std::uint32_t sequence_number = 0; sequence_number < 20; sequence_number++) {
+      for (std::size_t stream = first; stream < streams.size(); stream += 2) {
+        Packet packet = makeTestPacket(sequence_number, frame_size, frames_per_packet, streams[stream] + 1);
+        pool.Enqueue(streams[stream], &packet, 1);
+        free(packet.data);
+      }
+    }
+  };
+  std::thread even(produce, 0);
+  std::thread odd(produce, 1);
+  even.join();
+  odd.join();
+
+  // Every stream should play out everything, in whole packets, with its own data.
+  std::map<JitterBufferPool::StreamId, std::size_t> received;
+  for (std::size_t tick = 0; tick < 20; tick++) {
+    const auto &dequeued = pool.DequeueAll(frames_per_packet);
+    CHECK_EQ(dequeued.size(), streams.size());
+    for (const auto &output: dequeued) {
+      CHECK_EQ(output.elements, frames_per_packet);
+      CHECK_EQ(output.data[0], output.stream + 1);
+      received[output.stream] += output.elements;
+    }
+  }
+  for (const auto stream: streams) {
+    CHECK_EQ(received[stream], 20 * frames_per_packet);
+  }
+  CHECK(pool.DequeueAll(frames_per_packet).empty());
+
+  // Removed streams stop playing.
+  pool.RemoveStream(streams[0]);
+  Packet packet = makeTestPacket(20, frame_size, frames_per_packet);
+  pool.Enqueue(streams[0], &packet, 1);
+  pool.Enqueue(streams[1], &packet, 1);
+  free(packet.data);
+  const auto &dequeued = pool.DequeueAll(frames_per_packet);
+  REQUIRE_EQ(dequeued.size(), 1);
+  CHECK_EQ(dequeued[0].stream, streams[1]);
+  CHECK_THROWS_AS(pool.GetMetrics(streams[0]), const std::invalid_argument &);
+}
+
+TEST_CASE("libjitter_pool::ingress_wraps") {
+  const std::size_t frame_size = 2 * 2;
+  const std::size_t frames_per_packet = 48;
+  const std::size_t packets = 300;
+  auto logger = std::make_shared<cantina::Logger>("POOL", "TEST");
+  JitterBufferPool pool(1, [](JitterBufferPool::StreamId, std::span<Packet>) {
+    FAIL("Unexpected concealment");
+  }, logger, false);
+
+  std::vector<JitterBufferPool::StreamId> streams;
+  for (std::size_t stream = 0; stream < 4; stream++) {
+    streams.push_back(pool.AddStream(frame_size, frames_per_packet, 48000, milliseconds(500), milliseconds(0)));
+  }
+
+  // More calls than the shard's queue holds, from several threads at once, so producers wrap it and wait for room.
+  static_assert(4 * packets > JitterBufferPool::INGRESS_SLOTS);
+  std::vector<std::thread> producers;
+  for (const auto stream: streams) {
+    producers.emplace_back([&pool, stream]() {
+      for (std::uint32_t sequence_number = 0; sequence_number < packets; sequence_number++) {
+        Packet packet = makeTestPacket(sequence_number, frame_size, frames_per_packet);
+        pool.Enqueue(stream, &packet, 1);
+        free(packet.data);
+      }
+    });
+  }
+  for (std::thread &producer: producers) {
+    producer.join();
+  }
+
+  // Every stream's packets should arrive whole and in order.
+  const auto &dequeued = pool.DequeueAll(packets * frames_per_packet);
+  REQUIRE_EQ(dequeued.size(), streams.size());
+  for (const auto &output: dequeued) {
+    REQUIRE_EQ(output.elements, packets * frames_per_packet);
+    std::size_t mismatches = 0;
+    for (std::size_t element = 0; element < output.elements; element++) {
+      if (output.data[element * frame_size] != ((element / frames_per_packet) & 0xFF)) {
+        mismatches++;
+      }
+    }
+    CHECK_EQ(mismatches, 0);
+  }
+}
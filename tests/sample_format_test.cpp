@@ -0,0 +1,83 @@
+#include <doctest/doctest.h>
+#include "JitterBuffer.hh"
+#include "SampleFormat.hh"
+#include <vector>
+
+using namespace std::chrono;
+
+TEST_CASE("libjitter_sample_format::deinterleave") {
+  const std::vector<std::int16_t> source = {0, 16384, -32768, -16384, 32767, 1};
+  std::vector<float> destination(source.size());
+  ConvertSamples(reinterpret_cast<const std::uint8_t *>(source.data()), {SampleType::Int16, SampleLayout::Interleaved, 2}, 0,
+                 reinterpret_cast<std::uint8_t *>(destination.data()), {SampleType::Float32, SampleLayout::Planar, 2}, 3,
+                 3);
+  CHECK_EQ(destination, (std::vector<float>{0, -1, 32767.0F / 32768, 0.5F, -0.5F, 1.0F / 32768}));
+}
+
+TEST_CASE("libjitter_sample_format::interleave") {
+  // Out of range floats clip, and everything else rounds to nearest.
+  const std::vector<float> source = {2, -0.5F, 0.25F, -2, 0.5F, -0.25F};
+  std::vector<std::uint8_t> destination(source.size() * 3);
+  ConvertSamples(reinterpret_cast<const std::uint8_t *>(source.data()), {SampleType::Float32, SampleLayout::Planar, 2}, 3,
+                 destination.data(), {SampleType::Int24, SampleLayout::Interleaved, 2}, 0,
+                 3);
+  CHECK_EQ(destination, (std::vector<std::uint8_t>{0xFF, 0xFF, 0x7F, 0x00, 0x00, 0x80,
+                                                  0x00, 0x00, 0xC0, 0x00, 0x00, 0x40,
+                                                  0x00, 0x00, 0x20, 0x00, 0x00, 0xE0}));
+
+  // And back again, losslessly within range.
+  std::vector<std::int16_t> narrowed(source.size());
+  ConvertSamples(destination.data(), {SampleType::Int24, SampleLayout::Interleaved, 2}, 0,
+                 reinterpret_cast<std::uint8_t *>(narrowed.data()), {SampleType::Int16, SampleLayout::Interleaved, 2}, 0,
+                 3);
+  CHECK_EQ(narrowed, (std::vector<std::int16_t>{32767, -32768, -16384, 16384, 8192, -8192}));
+}
+
+TEST_CASE("libjitter_sample_format::mismatched_channels") {
+  const std::vector<std::int16_t> source(4);
+  std::vector<std::int16_t> destination(4);
+  CHECK_THROWS_AS(ConvertSamples(reinterpret_cast<const std::uint8_t *>(source.data()), {SampleType::Int16, SampleLayout::Interleaved, 2}, 0,
+                                 reinterpret_cast<std::uint8_t *>(destination.data()), {SampleType::Int16, SampleLayout::Interleaved, 1}, 0,
+                                 2),
+                  const std::invalid_argument &);
+}
+
+TEST_CASE("libjitter_sample_format::interpolate") {
+  // A ramp stays a ramp at any fractional position and rate.
+  std::vector<float> source(16);
+  for (std::size_t element = 0; element < source.size(); element++) {
+    source[element] = static_cast<float>(element) / 16;
+  }
+  std::vector<float> destination(4);
+  InterpolateSamples(reinterpret_cast<const std::uint8_t *>(source.data()), {SampleType::Float32, SampleLayout::Interleaved, 1}, 1.5, 2.25,
+                     reinterpret_cast<std::uint8_t *>(destination.data()), destination.size());
+  for (std::size_t element = 0; element < destination.size(); element++) {
+    CHECK_EQ(destination[element], doctest::Approx((1.5 + (static_cast<double>(element) * 2.25)) / 16));
+  }
+
+  CHECK_THROWS_AS(InterpolateSamples(reinterpret_cast<const std::uint8_t *>(source.data()), {SampleType::Float32, SampleLayout::Interleaved, 1}, 0.5, 1,
+                                     reinterpret_cast<std::uint8_t *>(destination.data()), 1),
+                  const std::invalid_argument &);
+}
+
+TEST_CASE("libjitter_sample_format::dequeue") {
+  const SampleFormat source_format = {SampleType::Int16, SampleLayout::Interleaved, 2};
+  const SampleFormat destination_format = {SampleType::Float32, SampleLayout::Planar, 2};
+  auto buffer = JitterBuffer(source_format.GetElementSize(), 4, 4000, milliseconds(100), milliseconds(0), std::make_shared<cantina::Logger>("", ""));
+  for (const std::int16_t sequence_number: {0, 1}) {
+    std::vector<std::int16_t> samples(8);
+    for (std::size_t element = 0; element < 4; element++) {
+      samples[element * 2] = static_cast<std::int16_t>(sequence_number * 8192);
+      samples[(element * 2) + 1] = static_cast<std::int16_t>(-sequence_number * 8192);
+    }
+    const Packet packet = {.sequence_number = static_cast<unsigned long>(sequence_number), .data = samples.data(), .length = samples.size() * sizeof(std::int16_t), .elements = 4};
+    buffer.Enqueue(&packet, 1, [](std::span<Packet>) {});
+  }
+
+  // Reading across packets keeps each channel in its own plane.
+  std::vector<float> destination(6 * 2);
+  REQUIRE_EQ(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(float), 6, source_format, destination_format), 6);
+  CHECK_EQ(destination, (std::vector<float>{0, 0, 0, 0, 0.25F, 0.25F, 0, 0, 0, 0, -0.25F, -0.25F}));
+
+  CHECK_THROWS_AS(buffer.Dequeue(reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() * sizeof(float), 1, {SampleType::Float32, SampleLayout::Interleaved, 1}, destination_format), const std::invalid_argument &);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "JitterBuffer.hh"
+#include "BufferInspector.hh"
 #include <chrono>
 #include <memory>
 #include <cassert>
@@ -20,7 +21,7 @@ static Packet makeTestPacket(const unsigned long sequence_number, const std::siz
 
 [[maybe_unused]] static bool checkPacketInSlot(const JitterBuffer* buffer, const Packet& packet, const std::size_t slot) {
   const std::uint8_t *read = buffer->GetReadPointerAtPacketOffset(slot);
-  const Header* header = reinterpret_cast<const Header*>(read - JitterBuffer::METADATA_SIZE);
+  const Header* header = BufferInspector(buffer).GetHeader(slot);
   return packet.sequence_number == header->sequence_number &&
          packet.elements == header->elements &&
          memcmp(packet.data, read, packet.length) == 0;
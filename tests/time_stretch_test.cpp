@@ -0,0 +1,52 @@
+#include <doctest/doctest.h>
+#include "TimeStretch.hh"
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <vector>
+
+namespace {
+  // 200Hz at 48kHz, so exactly 240 elements per period.
+  std::vector<std::int16_t> makeSine(const std::size_t elements) {
+    std::vector<std::int16_t> samples(elements);
+    for (std::size_t index = 0; index < elements; index++) {
+      samples[index] = static_cast<std::int16_t>(std::lround(10000 * std::sin(2 * std::numbers::pi * 200 * index / 48000)));
+    }
+    return samples;
+  }
+}
+
+TEST_CASE("libjitter_time_stretch::accelerate") {
+  const auto stretch = Wsola<std::int16_t>(1, 48000);
+  const std::vector<std::int16_t> source = makeSine(480 + stretch.GetLookahead());
+  std::vector<std::int16_t> destination(480);
+  const std::size_t consumed = stretch(reinterpret_cast<const std::uint8_t *>(source.data()), source.size(), reinterpret_cast<std::uint8_t *>(destination.data()), destination.size());
+
+  // One period should be skipped, seamlessly.
+  CHECK_EQ(consumed, 480 + 240);
+  CHECK_EQ(memcmp(destination.data(), source.data(), destination.size() * sizeof(std::int16_t)), 0);
+}
+
+TEST_CASE("libjitter_time_stretch::decelerate") {
+  const auto stretch = Wsola<std::int16_t>(1, 48000);
+  const std::vector<std::int16_t> source = makeSine(480);
+  std::vector<std::int16_t> destination(480);
+  const std::size_t consumed = stretch(reinterpret_cast<const std::uint8_t *>(source.data()), source.size(), reinterpret_cast<std::uint8_t *>(destination.data()), destination.size());
+
+  // One period should be repeated, seamlessly.
+  CHECK_EQ(consumed, 480 - 240);
+  CHECK_EQ(memcmp(destination.data(), source.data(), destination.size() * sizeof(std::int16_t)), 0);
+}
+
+TEST_CASE("libjitter_time_stretch::onset") {
+  // Silence into a tone can't be spliced without being heard, so should pass through untouched.
+  const auto stretch = Wsola<float>(2, 48000);
+  std::vector<float> source((480 + stretch.GetLookahead()) * 2, 0);
+  for (std::size_t index = 240 * 2; index < source.size(); index++) {
+    source[index] = std::sin(static_cast<float>(index));
+  }
+  std::vector<float> destination(480 * 2);
+  const std::size_t consumed = stretch(reinterpret_cast<const std::uint8_t *>(source.data()), source.size() / 2, reinterpret_cast<std::uint8_t *>(destination.data()), destination.size() / 2);
+  CHECK_EQ(consumed, 480);
+  CHECK_EQ(memcmp(destination.data(), source.data(), destination.size() * sizeof(float)), 0);
+}